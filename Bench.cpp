@@ -0,0 +1,453 @@
+#include "Bench.h"
+#include "Spatial.h"
+#include "Parallel.h"
+#include "Objects.h"
+#include "Projectiles.h"
+#include "MobKernels.h"
+#include "TimerWheel.h"
+#include "Engine.h"
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <thread>
+
+
+struct BenchBox {
+    int32_t x, y, w2, h2;
+};
+
+
+// chasers piled up around the player the way act_main leaves them late in a run,
+// plus player bullets spread over the screen
+static void make_cluster(std::mt19937 &rng, int32_t nmobs, int32_t spread, int32_t nbullets, std::vector<BenchBox> &mobs, std::vector<BenchBox> &bullets) {
+    std::normal_distribution<double> around(0., spread + 1.);
+    std::uniform_int_distribution<int32_t> xs(0, SCREEN_WIDTH - 1), ys(0, SCREEN_HEIGHT - 1);
+    mobs.clear();
+    bullets.clear();
+    for (int i = 0; i < nmobs; ++i) {
+        mobs.push_back({SCREEN_WIDTH / 2 + int32_t(around(rng)), SCREEN_HEIGHT / 2 + int32_t(around(rng)), 21, 21});
+    }
+    for (int i = 0; i < nbullets; ++i) {
+        bullets.push_back({xs(rng), ys(rng), 4, 4});
+    }
+}
+
+
+static void bench_broadphase() {
+    std::mt19937 rng(12345);
+    std::vector<BenchBox> mobs, bullets;
+    std::vector<int32_t> out;
+    const int32_t nbullets = 2000;
+    std::cout << "broadphase: " << nbullets << " bullets against clustered chasers, box tests per frame" << std::endl;
+    std::cout << "collide() takes the quadtree over the grid above a crowding of " << QUADTREE_CROWDING << std::endl;
+    std::cout << std::setw(8) << "mobs" << std::setw(8) << "spread" << std::setw(12) << "overlaps"
+              << std::setw(12) << "brute" << std::setw(12) << "grid" << std::setw(12) << "quadtree" << std::setw(8) << "nodes"
+              << std::setw(10) << "crowding" << std::setw(10) << "picked" << std::endl;
+    for (int32_t nmobs: {100, 250, 500, 1000, 2000}) {
+        for (int32_t spread: {0, 10, 20, 40, 60, 100}) {
+            make_cluster(rng, nmobs, spread, nbullets, mobs, bullets);
+            SpatialGrid grid;
+            QuadTree tree;
+            for (int i = 0; i < int(mobs.size()); ++i) {
+                grid.insert(i, mobs[i].x, mobs[i].y, mobs[i].w2, mobs[i].h2);
+                tree.insert(i, mobs[i].x, mobs[i].y, mobs[i].w2, mobs[i].h2);
+            }
+            grid.build();
+            tree.build();
+            int64_t overlaps = 0;
+            for (const BenchBox &b: bullets) {
+                AABB box = AABB::centered(b.x, b.y, b.w2, b.h2);
+                grid.within_box(box, out);
+                tree.within_box(box, out);
+                overlaps += out.size();
+            }
+            std::cout << std::setw(8) << nmobs << std::setw(8) << spread << std::setw(12) << overlaps
+                      << std::setw(12) << int64_t(nmobs) * nbullets << std::setw(12) << grid.pair_tests()
+                      << std::setw(12) << tree.pair_tests() << std::setw(8) << tree.node_count()
+                      << std::setw(10) << std::fixed << std::setprecision(1) << grid.crowding() << std::defaultfloat
+                      << std::setw(10) << (grid.crowding() > QUADTREE_CROWDING ? "quadtree" : "grid") << std::endl;
+        }
+    }
+}
+
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// bullet hell: player shots and enemy shots all over the screen, mobs and the player in the middle
+static void bench_sweep() {
+    std::mt19937 rng(777);
+    std::uniform_int_distribution<int32_t> xs(0, SCREEN_WIDTH - 1), ys(0, SCREEN_HEIGHT - 1);
+    std::vector<std::pair<int32_t, int32_t>> reference, pairs;
+    const int32_t repeats = 5;
+    std::cout << "sweep: contact pairs of player shots against enemy shots and mobs, ms per frame" << std::endl;
+    std::cout << std::setw(10) << "entities" << std::setw(10) << "pairs" << std::setw(10) << "serial";
+    for (int32_t nthreads: {1, 2, 4, 8}) {
+        std::cout << std::setw(9) << nthreads << "t";
+    }
+    std::cout << std::endl;
+    std::vector<ThreadPool*> pools;
+    for (int32_t nthreads: {1, 2, 4, 8}) {
+        pools.push_back(new ThreadPool(nthreads - 1));
+    }
+    for (int32_t nbullets: {5000, 20000, 50000}) {
+        SweepAndPrune sap;
+        for (int i = 0; i < nbullets; ++i) {
+            sap.insert(i, 2, 4, xs(rng), ys(rng), 4, 4);
+        }
+        for (int i = 0; i < nbullets; ++i) {
+            sap.insert(i, 4, 0, xs(rng), ys(rng), 3, 3);
+        }
+        for (int i = 0; i < 500; ++i) {
+            sap.insert(nbullets + i, 4, 0, xs(rng), ys(rng), 21, 21);
+        }
+        sap.insert(-1, 1, 4, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, 20, 20);
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            sap.find_pairs_serial(reference);
+        }
+        std::cout << std::setw(10) << sap.size() << std::setw(10) << reference.size() << std::setw(10) << std::setprecision(3) << ms_since(start) / repeats;
+        for (ThreadPool *pool: pools) {
+            start = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeats; ++r) {
+                sap.find_pairs(pairs, *pool);
+            }
+            double ms = ms_since(start) / repeats;
+            std::cout << std::setw(10) << std::setprecision(3) << ms;
+            if (pairs != reference) {
+                std::cout << " MISMATCH";
+            }
+        }
+        std::cout << std::endl;
+    }
+    for (ThreadPool *pool: pools) {
+        delete pool;
+    }
+}
+
+
+// Mob updates with a thread pool of each size. Every simulation step is one update
+// interval later than the last, so each act() moves every mob.
+static void bench_act() {
+    const int32_t frames = 20;
+    std::vector<ThreadPool*> pools;
+    std::cout << "act: mob update, ms per frame" << std::endl;
+    std::cout << std::setw(10) << "mobs";
+    for (int32_t nthreads: {1, 2, 4, 8}) {
+        pools.push_back(new ThreadPool(nthreads - 1));
+        std::cout << std::setw(9) << nthreads << "t";
+    }
+    std::cout << std::endl;
+    for (int32_t nmobs: {300, 3000, 9000}) {
+        std::cout << std::setw(10) << nmobs;
+        for (ThreadPool *pool: pools) {
+            MobCreator creator(0.5, 0.2, 0.5, 10000, 1000);
+            Player player(4, 100, 10000, 500, 500, 0.0, 0.0, "textures/player.png", "textures/monster_shot.png");
+            Living_Objects *objects = new Living_Objects();
+            objects->set_thread_pool(*pool);
+            for (int i = 0; i < nmobs / 3; ++i) {
+                objects->get_commands().spawn(creator.create_chaser());
+                objects->get_commands().spawn(creator.create_bouncer());
+                objects->get_commands().spawn(creator.create_shooter());
+            }
+            objects->apply_commands(player);
+            double ms = 0;
+            for (int f = 0; f < frames; ++f) {
+                const FrameTime &t = frame_clock().tick();
+                auto start = std::chrono::steady_clock::now();
+                objects->act(t, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+                ms += ms_since(start);
+                objects->apply_commands(player);
+            }
+            std::cout << std::setw(10) << std::setprecision(3) << ms / frames;
+            delete objects;
+        }
+        std::cout << std::endl;
+    }
+    for (ThreadPool *pool: pools) {
+        delete pool;
+    }
+}
+
+
+// Shots spread over the screen flying in every direction, ms per tick for moving them
+// with the scalar loop and the vector kernel, dropping the ones that left and drawing the rest.
+static void bench_projectiles() {
+    std::mt19937 rng(4242);
+    std::uniform_int_distribution<int32_t> xs(20, SCREEN_WIDTH - 21), ys(20, SCREEN_HEIGHT - 21);
+    std::uniform_real_distribution<double> dirs(-1., 1.);
+    Texture shot("textures/monster_shot.png");
+    const int32_t ticks = 20;
+    std::cout << "projectiles: ms per tick" << std::endl;
+    std::cout << std::setw(10) << "shots" << std::setw(10) << "scalar" << std::setw(10) << "simd" << std::setw(10) << "compact" << std::setw(10) << "draw" << std::setw(10) << "left" << std::endl;
+    for (int32_t nshots: {5000, 20000, 50000}) {
+        ProjectileSystem scalar, simd;
+        for (int i = 0; i < nshots; ++i) {
+            ProjectileSpawn s = {PLAYER_OWNER, 1.0, 1. + 3 * (i % 5), dirs(rng), dirs(rng), xs(rng), ys(rng), &shot};
+            scalar.spawn(s);
+            simd.spawn(s);
+        }
+        double scalar_ms = 0, simd_ms = 0, compact_ms = 0, draw_ms = 0;
+        bool same = true;
+        for (int t = 0; t < ticks; ++t) {
+            auto start = std::chrono::steady_clock::now();
+            scalar.integrate_scalar();
+            scalar_ms += ms_since(start);
+            start = std::chrono::steady_clock::now();
+            simd.integrate();
+            simd_ms += ms_since(start);
+            for (int32_t i = 0; i < simd.size(); ++i) {
+                same = same && scalar.get_xpos(i) == simd.get_xpos(i) && scalar.get_ypos(i) == simd.get_ypos(i) && scalar.is_alive(i) == simd.is_alive(i);
+            }
+            scalar.compact();
+            start = std::chrono::steady_clock::now();
+            simd.compact();
+            compact_ms += ms_since(start);
+            start = std::chrono::steady_clock::now();
+            simd.draw(PLAYER_OWNER, 1);
+            draw_ms += ms_since(start);
+        }
+        std::cout << std::setw(10) << nshots << std::setprecision(3) << std::setw(10) << scalar_ms / ticks << std::setw(10) << simd_ms / ticks
+                  << std::setw(10) << compact_ms / ticks << std::setw(10) << draw_ms / ticks << std::setw(10) << simd.size();
+        if (!same) {
+            std::cout << " MISMATCH";
+        }
+        std::cout << std::endl;
+    }
+}
+
+
+static void fill_batch(std::mt19937 &rng, int32_t n, double max_step, MobBatch &b) {
+    std::uniform_int_distribution<int32_t> xs(40, SCREEN_WIDTH - 41), ys(40, SCREEN_HEIGHT - 41), halves(8, 32);
+    std::uniform_real_distribution<double> steps(-max_step, max_step);
+    b.clear();
+    for (int32_t i = 0; i < n; ++i) {
+        b.push(i, xs(rng), ys(rng), halves(rng), halves(rng), 0, 0, steps(rng), steps(rng));
+    }
+}
+
+
+static bool same_batch(const MobBatch &a, const MobBatch &b) {
+    return a.xs == b.xs && a.ys == b.ys && a.xresidues == b.xresidues && a.yresidues == b.yresidues && a.walls == b.walls;
+}
+
+
+// bouncers turn around without rand() here so both batches keep the same directions
+static void turn_bouncers(MobBatch &b) {
+    for (int32_t k = 0; k < b.size(); ++k) {
+        if (b.walls[k] == X_WALL) {
+            b.xsteps[k] = -b.xsteps[k];
+        } else if (b.walls[k] == Y_WALL) {
+            b.ysteps[k] = -b.ysteps[k];
+        }
+        b.walls[k] = 0;
+    }
+}
+
+
+static void bench_kernels() {
+    std::mt19937 rng(4242);
+    const int32_t ticks = 200;
+    std::cout << "kernels: us per tick" << std::endl;
+    std::cout << std::setw(10) << "mobs" << std::setw(12) << "chase" << std::setw(12) << "chase simd" << std::setw(12) << "bounce" << std::setw(12) << "bounce simd" << std::endl;
+    for (int32_t nmobs: {256, 1024, 4096}) {
+        MobBatch chase_scalar, chase_simd, bounce_scalar, bounce_simd;
+        fill_batch(rng, nmobs, 4, chase_scalar);
+        chase_simd = chase_scalar;
+        fill_batch(rng, nmobs, 12, bounce_scalar);
+        bounce_simd = bounce_scalar;
+        double times[4] = {0, 0, 0, 0};
+        bool same = true;
+        for (int t = 0; t < ticks; ++t) {
+            int32_t xppos = SCREEN_WIDTH / 2 + t % 200, yppos = SCREEN_HEIGHT / 2 - t % 150;
+            auto start = std::chrono::steady_clock::now();
+            chase_batch_scalar(chase_scalar, xppos, yppos);
+            times[0] += ms_since(start);
+            start = std::chrono::steady_clock::now();
+            chase_batch(chase_simd, xppos, yppos);
+            times[1] += ms_since(start);
+            start = std::chrono::steady_clock::now();
+            bounce_batch_scalar(bounce_scalar);
+            times[2] += ms_since(start);
+            start = std::chrono::steady_clock::now();
+            bounce_batch(bounce_simd);
+            times[3] += ms_since(start);
+            same = same && same_batch(chase_scalar, chase_simd) && same_batch(bounce_scalar, bounce_simd);
+            turn_bouncers(bounce_scalar);
+            turn_bouncers(bounce_simd);
+        }
+        std::cout << std::setw(10) << nmobs << std::setprecision(3);
+        for (double ms: times) {
+            std::cout << std::setw(12) << ms * 1000 / ticks;
+        }
+        if (!same) {
+            std::cout << " MISMATCH";
+        }
+        std::cout << std::endl;
+    }
+}
+
+
+// Periodic timers with staggered phases like shooter fire timers, us per simulation step for
+// checking every timer against the time and for advancing a wheel holding them. Both count fires.
+static void bench_timers() {
+    const int32_t steps = 2000;
+    std::cout << "timers: us per step" << std::endl;
+    std::cout << std::setw(10) << "timers" << std::setw(10) << "poll" << std::setw(10) << "wheel" << std::setw(10) << "fired" << std::endl;
+    for (int32_t ntimers: {1000, 10000, 100000}) {
+        std::mt19937 rng(4242);
+        std::uniform_int_distribution<int32_t> periods(50, 150);
+        std::vector<int64_t> last(ntimers), period(ntimers);
+        TimerWheel wheel;
+        for (int32_t i = 0; i < ntimers; ++i) {
+            period[i] = periods(rng);
+            last[i] = -int64_t(rng() % period[i]);
+            wheel.schedule(period[i] + last[i], period[i], {SHOOT_TIMER, Handle{uint32_t(i), 1}});
+        }
+        int64_t polled = 0, fired = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t step = 1; step <= steps; ++step) {
+            for (int32_t i = 0; i < ntimers; ++i) {
+                if (step - last[i] >= period[i]) {
+                    last[i] = step;
+                    ++polled;
+                }
+            }
+        }
+        double poll_ms = ms_since(start);
+        start = std::chrono::steady_clock::now();
+        for (int64_t step = 1; step <= steps; ++step) {
+            wheel.advance(step, [&fired](const TimerEvent &) {
+                ++fired;
+                return true;
+            });
+        }
+        double wheel_ms = ms_since(start);
+        std::cout << std::setw(10) << ntimers << std::setprecision(3) << std::setw(10) << poll_ms * 1000 / steps << std::setw(10) << wheel_ms * 1000 / steps << std::setw(10) << fired;
+        if (polled != fired) {
+            std::cout << " MISMATCH";
+        }
+        std::cout << std::endl;
+    }
+}
+
+
+// Whole waves emitted into a fresh store, us per mob for building the wave into the command
+// buffer and for inserting it at the sync point.
+static void bench_waves() {
+    std::cout << "waves: us per mob" << std::endl;
+    std::cout << std::setw(10) << "mobs" << std::setw(10) << "emit" << std::setw(10) << "insert" << std::endl;
+    for (int32_t nmobs: {100, 500, 2000}) {
+        MobCreator creator(0.5, 0.2, 0.5, 10000, 1000);
+        Player player(4, 100, 10000, 500, 500, 0.0, 0.0, "textures/player.png", "textures/monster_shot.png");
+        Living_Objects *objects = new Living_Objects();
+        Wave w;
+        w.chasers = w.bouncers = nmobs * 2 / 5;
+        w.shooters = nmobs - w.chasers - w.bouncers;
+        w.formation = RING_FORMATION;
+        auto start = std::chrono::steady_clock::now();
+        creator.spawn_wave(w, 4, *objects);
+        double emit_ms = ms_since(start);
+        start = std::chrono::steady_clock::now();
+        objects->apply_commands(player);
+        double insert_ms = ms_since(start);
+        std::cout << std::setw(10) << nmobs << std::setprecision(3) << std::setw(10) << emit_ms * 1000 / nmobs << std::setw(10) << insert_ms * 1000 / nmobs << std::endl;
+        delete objects;
+    }
+}
+
+
+// ms per frame for filling the screen from a prebuilt full-screen copy of the background and
+// for drawing it from the tile, still and scrolling, plus the tiled draw at other resolutions.
+static void bench_background() {
+    const int32_t frames = 200;
+    BackGround tiled("textures/square_0x5d3fd3_31.png");
+    std::vector<uint32_t> full(SCREEN_WIDTH * SCREEN_HEIGHT);
+    tiled.draw(full.data(), SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_WIDTH);
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t f = 0; f < frames; ++f) {
+        memcpy(buffer, full.data(), full.size() * sizeof(uint32_t));
+    }
+    double copy_ms = ms_since(start) / frames;
+    start = std::chrono::steady_clock::now();
+    for (int32_t f = 0; f < frames; ++f) {
+        tiled.draw(&buffer[0][0], SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_WIDTH);
+    }
+    double tiled_ms = ms_since(start) / frames;
+    bool same = memcmp(buffer, full.data(), full.size() * sizeof(uint32_t)) == 0;
+    tiled.set_parallax(0.5);
+    start = std::chrono::steady_clock::now();
+    for (int32_t f = 0; f < frames; ++f) {
+        tiled.draw(&buffer[0][0], SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_WIDTH, 3 * f, -2 * f);
+    }
+    double scroll_ms = ms_since(start) / frames;
+    std::cout << "background: ms per frame at " << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << ", " << full.size() * sizeof(uint32_t) / 1024
+              << " KiB full screen, " << tiled.bytes() / 1024 << " KiB tile" << std::endl;
+    std::cout << std::setw(10) << "copy" << std::setw(10) << "tiled" << std::setw(10) << "scroll" << std::setw(10) << "same" << std::endl;
+    std::cout << std::setw(10) << copy_ms << std::setw(10) << tiled_ms << std::setw(10) << scroll_ms << std::setw(10) << (same ? "yes" : "NO") << std::endl;
+    std::cout << std::setw(12) << "resolution" << std::setw(10) << "tiled" << std::endl;
+    for (auto size: {std::make_pair(640, 480), std::make_pair(1920, 1080), std::make_pair(2560, 1440)}) {
+        std::vector<uint32_t> screen(size.first * size.second);
+        start = std::chrono::steady_clock::now();
+        for (int32_t f = 0; f < frames / 4; ++f) {
+            tiled.draw(screen.data(), size.first, size.second, size.first, f, f);
+        }
+        std::cout << std::setw(7) << size.first << "x" << std::setw(4) << size.second << std::setw(10) << ms_since(start) / (frames / 4) << std::endl;
+    }
+}
+
+
+// inline size of every entity type, the pixels behind each Texture come on top of this
+static void bench_footprint() {
+    struct Row {
+        const char *name;
+        size_t size;
+    };
+    const Row rows[] = {
+        {"Texture", sizeof(Texture)},
+        {"Object", sizeof(Object)},
+        {"ChaserMob", sizeof(ChaserMob)},
+        {"BouncerMob", sizeof(BouncerMob)},
+        {"AngleShooterMob", sizeof(AngleShooterMob)},
+        {"projectile", ProjectileSystem::bytes_per_projectile()},
+        {"Buff", sizeof(Buff)},
+    };
+    std::cout << std::setw(16) << "type" << std::setw(10) << "bytes" << std::setw(14) << "KiB per 10k" << std::endl;
+    for (const Row &row: rows) {
+        std::cout << std::setw(16) << row.name << std::setw(10) << row.size << std::setw(14) << row.size * 10000 / 1024 << std::endl;
+    }
+    const Texture &tex = texture_cache().get("textures/3_green_med.png");
+    Sprite sprite(tex);
+    std::cout << "sprite of " << SPRITE_FRAMES << " frames: " << SPRITE_FRAMES * 2 * tex.get_w() * tex.get_h() * sizeof(Pixel) / 1024
+              << " KiB as textures, " << sprite.bytes() / 1024 << " KiB indexed, " << sprite.get_palette().merged_colors() << " colours merged" << std::endl;
+}
+
+
+void run_bench(const char *name) {
+    if (strcmp(name, "broadphase") == 0) {
+        bench_broadphase();
+    } else if (strcmp(name, "sweep") == 0) {
+        bench_sweep();
+    } else if (strcmp(name, "act") == 0) {
+        bench_act();
+    } else if (strcmp(name, "projectiles") == 0) {
+        bench_projectiles();
+    } else if (strcmp(name, "kernels") == 0) {
+        bench_kernels();
+    } else if (strcmp(name, "timers") == 0) {
+        bench_timers();
+    } else if (strcmp(name, "waves") == 0) {
+        bench_waves();
+    } else if (strcmp(name, "background") == 0) {
+        bench_background();
+    } else if (strcmp(name, "footprint") == 0) {
+        bench_footprint();
+    } else {
+        std::cout << "unknown bench: " << name << std::endl;
+    }
+}
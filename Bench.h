@@ -0,0 +1,4 @@
+#pragma once
+
+// Offline measurements started with GW_BENCH=<name>, results go to stdout.
+void run_bench(const char *name);
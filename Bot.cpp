@@ -0,0 +1,45 @@
+#include "Bot.h"
+#include "Engine.h"
+#include <algorithm>
+
+
+StepInput Bot::input(const Living_Objects &objects, const Player &player) {
+    StepInput in;
+    int px = player.get_xpos(), py = player.get_ypos();
+    in.cursor_x = px;
+    in.cursor_y = py + 1;
+    objects.nearest(px, py, BOT_TARGETS, found);
+    double best = -1;
+    for (int32_t id: found) {
+        int32_t type = entity_type(id);
+        if (type == MOB_BULLET_TYPE || type == BUFF_TYPE) {
+            continue;
+        }
+        int x, y;
+        objects.position_of(id, x, y);
+        double d2 = double(x - px) * (x - px) + double(y - py) * (y - py);
+        if (best < 0 || d2 < best) {
+            best = d2;
+            in.cursor_x = x, in.cursor_y = y;
+        }
+    }
+    in.fire = best >= 0;
+
+    // everything close pushes by the inverse of its distance, buffs pull
+    double fx = 1. / std::max(px, 1) - 1. / std::max(SCREEN_WIDTH - px, 1);
+    double fy = 1. / std::max(py, 1) - 1. / std::max(SCREEN_HEIGHT - py, 1);
+    objects.within_radius(px, py, BOT_DANGER_RADIUS, found);
+    for (int32_t id: found) {
+        int x, y;
+        objects.position_of(id, x, y);
+        double dx = px - x, dy = py - y;
+        double d2 = std::max(dx * dx + dy * dy, 1.);
+        double sign = entity_type(id) == BUFF_TYPE ? -1 : 1;
+        fx += sign * dx / d2;
+        fy += sign * dy / d2;
+    }
+    const double eps = 1e-3;
+    in.xspeed = fx > eps ? 1 : (fx < -eps ? -1 : 0);
+    in.yspeed = fy > eps ? 1 : (fy < -eps ? -1 : 0);
+    return in;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Objects.h"
+#include <vector>
+
+#define BOT_TARGETS 8
+#define BOT_DANGER_RADIUS 200
+
+
+// What the player does in one simulation step, read from the keyboard and mouse or made up by the bot.
+struct StepInput {
+    int xspeed = 0, yspeed = 0;
+    int cursor_x = 0, cursor_y = 0;
+    bool fire = false;
+};
+
+
+// Stand-in player for the fast forward runs. Shoots at the nearest mob, steps away from the mobs
+// and shots close by, walks towards buffs and keeps off the walls. It only looks at the world
+// through the spatial queries of Living_Objects.
+class Bot {
+    std::vector<int32_t> found;
+    public:
+    StepInput input(const Living_Objects &objects, const Player &player);
+};
@@ -0,0 +1,28 @@
+#include "FrameClock.h"
+#include <algorithm>
+
+
+// dt in seconds, returns the number of steps to run this frame
+int32_t FrameClock::advance(double dt) {
+    accumulator += dt * 1000;
+    int32_t steps = int32_t(accumulator / SIM_STEP_MS);
+    if (steps > SIM_MAX_STEPS) {
+        steps = SIM_MAX_STEPS;
+        accumulator = SIM_MAX_STEPS * SIM_STEP_MS;
+    }
+    accumulator = std::max(accumulator - steps * SIM_STEP_MS, 0.);
+    return steps;
+}
+
+
+const FrameTime& FrameClock::tick() {
+    current.now += SIM_STEP_MS;
+    ++current.frame;
+    return current;
+}
+
+
+FrameClock& frame_clock() {
+    static FrameClock clock;
+    return clock;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#define SIM_STEP_MS 10
+#define SIM_MAX_STEPS 8
+
+
+// Time of the simulation step being run. Steps are SIM_STEP_MS apart however fast frames come,
+// so every timer in act() sees the same sequence of times at any frame rate.
+struct FrameTime {
+    int64_t now = 0;
+    int64_t dt = SIM_STEP_MS;
+    int64_t frame = 0;
+};
+
+
+// Turns the real time between frames into a whole number of fixed steps. What is left over
+// stays in the accumulator for the next frame and gives the fraction drawing interpolates by.
+// A frame never runs more than SIM_MAX_STEPS, the time beyond that is dropped so a stall
+// slows the game down instead of freezing it with catch-up work.
+class FrameClock {
+    double accumulator = 0;
+    FrameTime current;
+    public:
+    int32_t advance(double dt);
+    const FrameTime& tick();
+    const FrameTime& get() const {return current;}
+    double alpha() const {return accumulator / SIM_STEP_MS;}
+};
+
+
+// Clock of the game loop. Entities created during a step start their timers at its now.
+FrameClock& frame_clock();
+inline int64_t frame_now() {return frame_clock().get().now;}
+inline uint32_t steps_of(int64_t ms) {return uint32_t((ms + SIM_STEP_MS - 1) / SIM_STEP_MS);}
+
+
+// position to draw at, alpha of the clock between the previous step and the last one
+inline int32_t lerp_position(int32_t from, int32_t to, double alpha) {
+    return from + int32_t((to - from) * alpha + (to >= from ? 0.5 : -0.5));
+}
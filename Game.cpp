@@ -1,14 +1,30 @@
 #include "Engine.h"
 #include "Objects.h"
+#include "Bench.h"
+#include "Bot.h"
+#include "Lazy.h"
 #include <stdlib.h>
 #include <memory.h>
 
 #include <stdio.h>
 #include <chrono>
 #include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unistd.h>
+#include <algorithm>
 
 #include <stdint.h>
 
+#define FAST_FORWARD_REPORT_S 30
+#define LOAD_RAMP_LEVEL_S 5
+#define LOAD_RAMP_BURST 4
+#define LOAD_RAMP_MAX_LEVELS 200
+#define DEATH_PREFETCH_HP 1
+#define DEATH_PREFETCH_DISTANCE 150
+
 //
 //  You are free to modify this file
 //
@@ -22,60 +38,214 @@
 
 // debug FPS counter
 
-BackGround background("textures/square_0x5d3fd3_31.png");
-DeathBackGround deathbackground;
+// The background tile is loaded and the death screen filled in when they are first drawn.
+// The death screen is started on its own thread once the player is down to DEATH_PREFETCH_HP
+// and a mob or an enemy shot comes within DEATH_PREFETCH_DISTANCE, so a game nobody loses
+// never builds it.
+Lazy<BackGround> background([] {return new BackGround("textures/square_0x5d3fd3_31.png");});
+Lazy<DeathBackGround> deathbackground([] {return new DeathBackGround;});
+
+// built by load_assets() in initialize()
 Living_Objects objects;
-Player player(4, 100, 10000, 500, 500, 0.0, 0.0, "textures/player.png", "textures/monster_shot.png");
-Texture pbullet("textures/monster_shot.png");
-Score score_counter(9);
-MobCreator mob_creator(0.5, 0.2, 0.5, 10000, 1000);
+std::unique_ptr<Player> player;
+const Texture *pbullet = nullptr;
+std::unique_ptr<Score> score_counter;
+std::unique_ptr<MobCreator> mob_creator;
+
+// everything the objects above draw, decoded together before they are built
+static const std::vector<TextureRequest> GAME_TEXTURES {
+    {"textures/player.png", false}, {"textures/monster_shot.png", false}, {"textures/health.png", false},
+    {"textures/speed.png", false}, {"textures/bonus.png", false}, {"textures/joe.png", false},
+    {"textures/joebullet.png", false}, {"textures/3_green_med.png", false}, {"textures/3_salad_med.png", false},
+    {"textures/4_yellow_thin.png", false}, {"textures/inner_5_0xe97451_50.png", false},
+    {"textures/inner_6_0xfafa33_75.png", false}, {"textures/circle_0xa36c_175_43.png", false},
+    {"textures/circle_green.png", false}, {"textures/circle_purple.png", false},
+    {"textures/0.png", true}, {"textures/1.png", true}, {"textures/2.png", true}, {"textures/3.png", true},
+    {"textures/4.png", true}, {"textures/5.png", true}, {"textures/6.png", true}, {"textures/7.png", true},
+    {"textures/8.png", true}, {"textures/9.png", true}
+};
 
 
 int32_t FRAME_COUNTER = 0;
 int64_t fps_timer = 0;
 void get_fps_count() {
-    if (fps_timer == 0) {
-        fps_timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    } else {
-        auto fps_timer1 = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-        if (fps_timer1 - fps_timer > 1000) {
+    int64_t now = frame_clock().get().now;
+    if (now - fps_timer > 1000) {
         std::cout << "fps: " << FRAME_COUNTER << std::endl;
-        fps_timer = fps_timer1;
+        fps_timer = now;
         FRAME_COUNTER = 0;
+    }
+    FRAME_COUNTER++;
+}
+
+
+enum FramePhase {
+    PLAYER_PHASE,
+    ACT_PHASE,
+    COLLIDE_PHASE,
+    SPAWN_PHASE,
+    DRAW_PHASE,
+    PHASE_COUNT
+};
+
+
+// Time spent in each part of a frame. start() marks the beginning, every lap() books the
+// time since the last mark to its phase.
+struct PhaseTimes {
+    double ms[PHASE_COUNT] = {};
+    std::chrono::steady_clock::time_point mark;
+
+    void start() {mark = std::chrono::steady_clock::now();}
+    void lap(int32_t phase) {
+        auto now = std::chrono::steady_clock::now();
+        ms[phase] += std::chrono::duration<double, std::milli>(now - mark).count();
+        mark = now;
+    }
+    double total() const {
+        double sum = 0;
+        for (double phase_ms: ms) {
+            sum += phase_ms;
         }
-        FRAME_COUNTER++;
+        return sum;
     }
+};
+
+
+void fast_forward(double minutes, bool with_draw);
+void load_ramp(double fps, bool with_fire);
+
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
 
-// initialize game data in this function
-void initialize() {}
+// resident set of the process in KiB, 0 without /proc
+static int64_t resident_kib() {
+    std::ifstream statm("/proc/self/statm");
+    int64_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
 
 
-// this function is called to update game data,
-// dt - time elapsed since the previous update (in seconds)
-void act(float dt) {
-    if (is_key_pressed(VK_ESCAPE))
+// The load phase. The textures are decoded on every thread of the pool, then the objects
+// holding them are built side by side, and last the mob creator rotates its sprite frames
+// on the pool as well. The backgrounds are not part of it, see above.
+static void load_assets() {
+    ThreadPool &pool = thread_pool();
+    auto start = std::chrono::steady_clock::now();
+    texture_cache().preload(GAME_TEXTURES, pool);
+    double decode_ms = ms_since(start);
+    pool.run(2, [](int32_t job) {
+        switch (job) {
+            case 0:
+                score_counter.reset(new Score(9));
+                break;
+            default:
+                player.reset(new Player(4, 100, 10000, 500, 500, 0.0, 0.0, "textures/player.png", "textures/monster_shot.png"));
+        }
+    });
+    mob_creator.reset(new MobCreator(0.5, 0.2, 0.5, 10000, 1000, &pool));
+    pbullet = &texture_cache().get("textures/monster_shot.png");
+    std::cout << "assets: " << GAME_TEXTURES.size() << " textures in " << decode_ms << " ms, ready in " << ms_since(start)
+              << " ms on " << pool.size() << " threads, " << resident_kib() / 1024 << " MiB resident" << std::endl;
+}
+
+
+// initialize game data in this function
+void initialize() {
+    load_assets();
+    if (const char *waves = getenv("GW_WAVES")) {
+        if (!mob_creator->load_waves(waves, std::cerr)) {
+            std::cerr << "cannot read wave table " << waves << std::endl;
+        }
+    }
+    if (const char *parallax = getenv("GW_PARALLAX")) {
+        background.get().set_parallax(atof(parallax));
+    }
+    if (const char *bench = getenv("GW_BENCH")) {
+        run_bench(bench);
+        schedule_quit_game();
+    } else if (const char *minutes = getenv("GW_FAST_FORWARD")) {
+        fast_forward(atof(minutes), getenv("GW_FAST_FORWARD_DRAW") != nullptr);
+        schedule_quit_game();
+    } else if (const char *fps = getenv("GW_LOAD_RAMP")) {
+        load_ramp(atof(fps), getenv("GW_LOAD_RAMP_FIRE") != nullptr);
         schedule_quit_game();
+    }
+}
+
+
+StepInput read_input() {
+    StepInput in;
     if (is_key_pressed(VK_LEFT))
-        player.set_xspeed(-1);
+        in.xspeed = -1;
     if (is_key_pressed(VK_RIGHT))
-        player.set_xspeed(1);
+        in.xspeed = 1;
     if (is_key_pressed(VK_DOWN))
-        player.set_yspeed(1);
+        in.yspeed = 1;
     if (is_key_pressed(VK_UP))
-        player.set_yspeed(-1);
-    player.set_dir(get_cursor_x(), get_cursor_y());
-    if (is_mouse_button_pressed(0) && player.can_shoot()) {
-        Object *bullet = new PlayerBullet(2.0, 15, player.get_xdir(), player.get_ydir(),  player.get_xpos(), player.get_ypos(), pbullet, 10);
-        objects.add_pbullet(bullet);
+        in.yspeed = -1;
+    in.cursor_x = get_cursor_x();
+    in.cursor_y = get_cursor_y();
+    in.fire = is_mouse_button_pressed(0);
+    return in;
+}
+
+
+// anything but a buff within DEATH_PREFETCH_DISTANCE, as indexed at the end of the last step
+static bool threat_near(int x, int y) {
+    static std::vector<int32_t> near;
+    objects.within_radius(x, y, DEATH_PREFETCH_DISTANCE, near);
+    for (int32_t id: near) {
+        if (entity_type(id) != BUFF_TYPE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// one fixed step of the simulation, input is read again at every step
+void step(const FrameTime &t, const StepInput &in, PhaseTimes *times = nullptr) {
+    if (in.xspeed != 0)
+        player->set_xspeed(in.xspeed);
+    if (in.yspeed != 0)
+        player->set_yspeed(in.yspeed);
+    player->set_dir(in.cursor_x, in.cursor_y);
+    if (in.fire && player->can_shoot(t)) {
+        objects.get_commands().spawn_projectile(PLAYER_OWNER, 2.0, 15, player->get_xdir(), player->get_ydir(), player->get_xpos(), player->get_ypos(), *pbullet);
+    }
+    player->act(t);
+    if (times != nullptr)
+        times->lap(PLAYER_PHASE);
+    objects.act(t, player->get_xpos(), player->get_ypos());
+    if (times != nullptr)
+        times->lap(ACT_PHASE);
+    if (!player->is_dead()) {
+        if (player->get_hp() <= DEATH_PREFETCH_HP && threat_near(player->get_xpos(), player->get_ypos())) {
+            deathbackground.prefetch();
+        }
+        int32_t kill_score = objects.collide(t, *player);
+        score_counter->add_score(kill_score * 100);
     }
-    player.act();
-    int32_t nlive = objects.act(player.get_xpos(), player.get_ypos());
-    objects.give_buffs(player);
-    Object *new_mob = mob_creator.act(nlive);
-    if (new_mob != nullptr) {
-        objects.add(new_mob);
+    if (times != nullptr)
+        times->lap(COLLIDE_PHASE);
+    mob_creator->act(t, objects);
+    objects.apply_commands(*player);
+    if (times != nullptr)
+        times->lap(SPAWN_PHASE);
+}
+
+
+// this function is called to update game data,
+// dt - time elapsed since the previous update (in seconds)
+void act(float dt) {
+    if (is_key_pressed(VK_ESCAPE))
+        schedule_quit_game();
+    for (int32_t steps = frame_clock().advance(dt); steps > 0; --steps) {
+        step(frame_clock().tick(), read_input());
     }
 }
 
@@ -83,16 +253,15 @@ void act(float dt) {
 // fill buffer in this function
 // uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH] - is an array of 32-bit colors (8 bits per R, G, B)
 void draw() {
-    if (player.is_dead()) {
-        memcpy(buffer, deathbackground.background, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
+    if (player->is_dead()) {
+        memcpy(buffer, deathbackground.get().background, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
     } else {
-        memset(mob_map, 0, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(int32_t));
-        memcpy(buffer, background.background, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
-        score_counter.draw();
-        int32_t kill_score = objects.draw();
-        score_counter.add_score(kill_score * 100);
-        player.draw();
-        player.draw_stats();
+        background.get().draw(&buffer[0][0], SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_WIDTH, player->get_xpos() - SCREEN_WIDTH / 2, player->get_ypos() - SCREEN_HEIGHT / 2);
+        score_counter->draw();
+        double alpha = frame_clock().alpha();
+        objects.draw(alpha);
+        player->draw(alpha);
+        player->draw_stats();
     }
     //get_fps_count();
 }
@@ -100,5 +269,105 @@ void draw() {
 
 // free game data in this function
 void finalize() {
+    objects.report_pools(std::cout);
+    texture_cache().report(std::cout);
 }
 
+
+// Plays the given number of game minutes with the bot as fast as the machine allows, drawing
+// every step only if asked. Every FAST_FORWARD_REPORT_S of game time prints what is alive, kills,
+// score and the cost of the steps since the last line.
+void fast_forward(double minutes, bool with_draw) {
+    Bot bot;
+    int64_t steps = int64_t(minutes * 60000 / SIM_STEP_MS), report_steps = FAST_FORWARD_REPORT_S * 1000 / SIM_STEP_MS;
+    double sum_ms = 0, max_ms = 0;
+    std::cout << "seed " << rng_seed() << std::endl;
+    std::cout << std::setw(8) << "time" << std::setw(9) << "chasers" << std::setw(9) << "bouncers" << std::setw(9) << "shooters"
+              << std::setw(8) << "shots" << std::setw(8) << "kills" << std::setw(10) << "score" << std::setw(4) << "hp"
+              << std::setw(10) << "ms/step" << std::setw(10) << "max ms" << std::endl;
+    for (int64_t k = 1; k <= steps; ++k) {
+        auto start = std::chrono::steady_clock::now();
+        step(frame_clock().tick(), bot.input(objects, *player));
+        if (with_draw) {
+            draw();
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        sum_ms += ms;
+        max_ms = std::max(max_ms, ms);
+        if (k % report_steps == 0 || k == steps) {
+            int64_t seconds = frame_clock().get().now / 1000;
+            int64_t n = (k - 1) % report_steps + 1;
+            std::cout << std::setw(5) << seconds / 60 << ":" << std::setw(2) << std::setfill('0') << seconds % 60 << std::setfill(' ')
+                      << std::setw(9) << objects.count_of(CHASER_TYPE) << std::setw(9) << objects.count_of(BOUNCER_TYPE)
+                      << std::setw(9) << objects.count_of(SHOOTER_TYPE) << std::setw(8) << objects.count_of(MOB_BULLET_TYPE)
+                      << std::setw(8) << objects.get_kills() << std::setw(10) << score_counter->get_score() << std::setw(4) << player->get_hp()
+                      << std::fixed << std::setprecision(3) << std::setw(10) << sum_ms / n << std::setw(10) << max_ms << std::defaultfloat << std::endl;
+            sum_ms = max_ms = 0;
+        }
+    }
+}
+
+
+static double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(size_t(p * values.size()), values.size() - 1)];
+}
+
+
+// Finds how many entities the machine keeps up with at the given frame rate. The bot plays
+// frames of 1 / fps seconds, all drawn, and every LOAD_RAMP_LEVEL_S of game time the spawner
+// brings LOAD_RAMP_BURST more mobs per spawn, with the fire rate going up as well if asked.
+// Each level prints the entity count, frame percentiles and the average cost of every phase
+// of a frame; the first level with a 99th percentile frame over budget ends the run. The
+// player is healed at every level so the collision phase stays in the measure.
+void load_ramp(double fps, bool with_fire) {
+    Bot bot;
+    double budget_ms = 1000 / fps;
+    int32_t frames = std::max(int32_t(fps * LOAD_RAMP_LEVEL_S), 1);
+    std::vector<double> frame_ms(frames);
+    int32_t held_mobs = 0, held_shots = 0, held_level = 0;
+    std::cout << "seed " << rng_seed() << ", " << fps << " fps, budget " << budget_ms << " ms" << std::endl;
+    std::cout << std::setw(6) << "level" << std::setw(7) << "mobs" << std::setw(7) << "shots" << std::setw(9) << "p50 ms"
+              << std::setw(9) << "p99 ms" << std::setw(9) << "player" << std::setw(9) << "act" << std::setw(9) << "collide"
+              << std::setw(9) << "spawn" << std::setw(9) << "draw" << std::endl;
+    for (int32_t level = 1; level <= LOAD_RAMP_MAX_LEVELS; ++level) {
+        mob_creator->set_load(level * LOAD_RAMP_BURST);
+        if (with_fire) {
+            player->set_shoot_speed(100. / level);
+        }
+        player->add_hp(9);
+        PhaseTimes times;
+        for (int32_t f = 0; f < frames; ++f) {
+            double before = times.total();
+            for (int32_t steps = frame_clock().advance(1 / fps); steps > 0; --steps) {
+                const FrameTime &t = frame_clock().tick();
+                StepInput in = bot.input(objects, *player);
+                times.start();
+                step(t, in, &times);
+            }
+            times.start();
+            draw();
+            times.lap(DRAW_PHASE);
+            frame_ms[f] = times.total() - before;
+        }
+        int32_t mobs = objects.count_of(CHASER_TYPE) + objects.count_of(BOUNCER_TYPE) + objects.count_of(SHOOTER_TYPE);
+        int32_t shots = objects.count_of(MOB_BULLET_TYPE);
+        double p99 = percentile(frame_ms, 0.99);
+        std::cout << std::setw(6) << level << std::setw(7) << mobs << std::setw(7) << shots << std::fixed << std::setprecision(3)
+                  << std::setw(9) << percentile(frame_ms, 0.5) << std::setw(9) << p99;
+        for (double phase_ms: times.ms) {
+            std::cout << std::setw(9) << phase_ms / frames;
+        }
+        std::cout << std::defaultfloat << std::endl;
+        if (p99 > budget_ms) {
+            break;
+        }
+        held_mobs = mobs, held_shots = shots, held_level = level;
+    }
+    if (held_level == LOAD_RAMP_MAX_LEVELS) {
+        std::cout << "still within budget after " << held_level << " levels: ";
+    } else {
+        std::cout << "capacity at " << fps << " fps: ";
+    }
+    std::cout << held_mobs << " mobs and " << held_shots << " shots, level " << held_level << std::endl;
+}
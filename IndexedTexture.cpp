@@ -0,0 +1,86 @@
+#include "IndexedTexture.h"
+#include "Engine.h"
+#include <algorithm>
+
+
+static uint32_t premultiply(Pixel p) {
+    return (uint32_t(p.a) << 24) + (uint32_t(p.r) * p.a / 255 << 16) + (uint32_t(p.g) * p.a / 255 << 8) + uint32_t(p.b) * p.a / 255;
+}
+
+
+static int32_t distance(uint32_t a, uint32_t b) {
+    int32_t d = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int32_t c = int32_t(a >> shift & 255) - int32_t(b >> shift & 255);
+        d += c * c;
+    }
+    return d;
+}
+
+
+Palette::Palette(const Pixel *pixels, int32_t count) {
+    std::unordered_map<uint32_t, int32_t> uses;
+    for (int32_t i = 0; i < count; ++i) {
+        ++uses[pixels[i].pixel()];
+    }
+    uses.erase(Pixel().pixel());
+    std::vector<std::pair<int32_t, uint32_t>> order;
+    for (auto &u: uses) {
+        order.push_back({-u.second, u.first});
+    }
+    std::sort(order.begin(), order.end());
+    colors.push_back(Pixel());
+    premultiplied.push_back(0);
+    index[Pixel().pixel()] = 0;
+    for (auto &o: order) {
+        Pixel p(o.second);
+        if (colors.size() < PALETTE_SIZE) {
+            index[o.second] = colors.size();
+            colors.push_back(p);
+            premultiplied.push_back(premultiply(p));
+            continue;
+        }
+        uint32_t pre = premultiply(p);
+        int32_t best = 0, best_distance = INT32_MAX;
+        for (int32_t k = 0; k < int32_t(colors.size()); ++k) {
+            int32_t d = distance(pre, premultiplied[k]);
+            if (colors[k].is_color() == p.is_color() && d < best_distance) {
+                best = k, best_distance = d;
+            }
+        }
+        index[o.second] = best;
+        ++merged;
+    }
+}
+
+
+uint8_t Palette::index_of(Pixel p) const {
+    auto it = index.find(p.pixel());
+    return it != index.end() ? it->second : 0;
+}
+
+
+IndexedTexture::IndexedTexture(const Pixel *pixels, int width, int height, const Palette &palette):
+            palette(&palette), indices(width * height), height(height), width(width), h2(height / 2), w2(width / 2) {
+    for (int i = 0; i < width * height; ++i) {
+        indices[i] = palette.index_of(pixels[i]);
+    }
+}
+
+
+// the same sums as Pixel::alpha_mix with the colour side already multiplied out
+void IndexedTexture::draw(int x, int y) const {
+    int i0 = std::max(y - h2, 0), i1 = std::min(y + h2, SCREEN_HEIGHT);
+    int j0 = std::max(x - w2, 0), j1 = std::min(x + w2, SCREEN_WIDTH);
+    for (int i = i0; i < i1; ++i) {
+        int row = (i - y + h2) * width - x + w2;
+        for (int j = j0; j < j1; ++j) {
+            uint32_t color = palette->premultiplied_color(indices[row + j]), dst = buffer[i][j];
+            uint32_t rest = 255 - (color >> 24);
+            uint32_t r = (color >> 16 & 255) + (dst >> 16 & 255) * rest / 255;
+            uint32_t g = (color >> 8 & 255) + (dst >> 8 & 255) * rest / 255;
+            uint32_t b = (color & 255) + (dst & 255) * rest / 255;
+            buffer[i][j] = 0xff000000 + (r << 16) + (g << 8) + b;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Pixel.h"
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#define PALETTE_SIZE 256
+
+
+// The colours of one texture, index 0 being the empty pixel. Past PALETTE_SIZE colours the
+// most used ones are kept and the rest are drawn as the closest kept colour, which is only
+// ever taken among those is_color() agrees with, so hit tests see the same shape.
+class Palette {
+    std::vector<Pixel> colors;
+    std::vector<uint32_t> premultiplied;
+    std::unordered_map<uint32_t, uint8_t> index;
+    int32_t merged = 0;
+    public:
+    Palette(const Pixel *pixels, int32_t count);
+    uint8_t index_of(Pixel p) const;
+    const Pixel& color(uint8_t i) const {return colors[i];}
+    uint32_t premultiplied_color(uint8_t i) const {return premultiplied[i];}
+    int32_t size() const {return colors.size();}
+    int32_t merged_colors() const {return merged;}
+};
+
+
+// One byte per pixel into a palette shared with the other frames of the same sprite. Reads go
+// like those of a const Texture, draw() blends the premultiplied colours straight from it.
+class IndexedTexture {
+    const Palette *palette = nullptr;
+    std::vector<uint8_t> indices;
+    int height = 0, width = 0;
+    int h2 = 0, w2 = 0;
+    public:
+    IndexedTexture(){}
+    IndexedTexture(const Pixel *pixels, int width, int height, const Palette &palette);
+
+    const Pixel& operator[](const int i) const {return palette->color(indices[i]);}
+    int get_h() const {return height;}
+    int get_h2() const {return h2;}
+    int get_w() const {return width;}
+    int get_w2() const {return w2;}
+    size_t bytes() const {return indices.size();}
+    void draw(int x, int y) const;
+};
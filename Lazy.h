@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <memory>
+
+
+// An object that is only built the first time it is asked for. prefetch() starts building it
+// on a thread of its own when it is likely to be needed soon, the next get() then waits for
+// that instead of building it again. get() and prefetch() are called from one thread.
+template <class T>
+class Lazy {
+    std::function<T*()> make;
+    std::unique_ptr<T> value;
+    std::future<T*> pending;
+    public:
+    explicit Lazy(std::function<T*()> make): make(std::move(make)) {}
+    Lazy(const Lazy &c) = delete;
+    ~Lazy() {
+        if (pending.valid()) {
+            value.reset(pending.get());
+        }
+    }
+
+    T& get() {
+        if (value == nullptr) {
+            value.reset(pending.valid() ? pending.get() : make());
+        }
+        return *value;
+    }
+    void prefetch() {
+        if (value == nullptr && !pending.valid()) {
+            pending = std::async(std::launch::async, make);
+        }
+    }
+};
@@ -0,0 +1,200 @@
+#include "MobKernels.h"
+#include "Engine.h"
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+void MobBatch::clear() {
+    index.clear();
+    xs.clear();
+    ys.clear();
+    w2s.clear();
+    h2s.clear();
+    xresidues.clear();
+    yresidues.clear();
+    xsteps.clear();
+    ysteps.clear();
+    walls.clear();
+}
+
+
+void MobBatch::push(int32_t i, int32_t x, int32_t y, int32_t w2, int32_t h2, double xresidue, double yresidue, double xstep, double ystep) {
+    index.push_back(i);
+    xs.push_back(x);
+    ys.push_back(y);
+    w2s.push_back(w2);
+    h2s.push_back(h2);
+    xresidues.push_back(xresidue);
+    yresidues.push_back(yresidue);
+    xsteps.push_back(xstep);
+    ysteps.push_back(ystep);
+    walls.push_back(0);
+}
+
+
+// Chasers
+
+static inline void chase_axis(int32_t &x, double &residue, double speed, int32_t target, int32_t half, int32_t limit) {
+    residue += speed;
+    int32_t step = int32_t(residue);
+    residue -= step;
+    if (target <= x - step) {
+        x -= step;
+    } else if (target >= x + step) {
+        x += step;
+    }
+    x = std::min(std::max(x, half), limit - 1 - half);
+}
+
+
+static void chase_range(MobBatch &b, int32_t begin, int32_t end, int32_t xppos, int32_t yppos) {
+    for (int32_t i = begin; i < end; ++i) {
+        chase_axis(b.xs[i], b.xresidues[i], b.xsteps[i], xppos, b.w2s[i], SCREEN_WIDTH);
+        chase_axis(b.ys[i], b.yresidues[i], b.ysteps[i], yppos, b.h2s[i], SCREEN_HEIGHT);
+    }
+}
+
+
+void chase_batch_scalar(MobBatch &b, int32_t xppos, int32_t yppos) {
+    chase_range(b, 0, b.size(), xppos, yppos);
+}
+
+
+// Bouncers
+
+static inline void bounce_axis(int32_t &x, double &residue, double dir) {
+    residue += dir;
+    int32_t step = int32_t(residue);
+    residue -= step;
+    x += step;
+}
+
+
+static void bounce_range(MobBatch &b, int32_t begin, int32_t end) {
+    for (int32_t i = begin; i < end; ++i) {
+        bounce_axis(b.xs[i], b.xresidues[i], b.xsteps[i]);
+        bounce_axis(b.ys[i], b.yresidues[i], b.ysteps[i]);
+        int32_t &x = b.xs[i], &y = b.ys[i];
+        if (x < b.w2s[i] || x > SCREEN_WIDTH - 1 - b.w2s[i]) {
+            b.walls[i] = X_WALL;
+        } else if (y < b.h2s[i] || y > SCREEN_HEIGHT - 1 - b.h2s[i]) {
+            b.walls[i] = Y_WALL;
+        }
+        x = std::min(std::max(x, b.w2s[i]), SCREEN_WIDTH - 1 - b.w2s[i]);
+        y = std::min(std::max(y, b.h2s[i]), SCREEN_HEIGHT - 1 - b.h2s[i]);
+    }
+}
+
+
+void bounce_batch_scalar(MobBatch &b) {
+    bounce_range(b, 0, b.size());
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+// Eight mobs per iteration. The residues advance in two halves of four doubles, whole steps
+// are truncated like the int32_t casts of the scalar code and the rest runs on eight int32
+// lanes with the branches turned into masks.
+
+__attribute__((target("avx2")))
+static inline __m256i advance8(double *residues, const double *steps) {
+    __m256d lo = _mm256_add_pd(_mm256_loadu_pd(residues), _mm256_loadu_pd(steps));
+    __m256d hi = _mm256_add_pd(_mm256_loadu_pd(residues + 4), _mm256_loadu_pd(steps + 4));
+    __m256d whole_lo = _mm256_round_pd(lo, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256d whole_hi = _mm256_round_pd(hi, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    _mm256_storeu_pd(residues, _mm256_sub_pd(lo, whole_lo));
+    _mm256_storeu_pd(residues + 4, _mm256_sub_pd(hi, whole_hi));
+    return _mm256_set_m128i(_mm256_cvttpd_epi32(whole_hi), _mm256_cvttpd_epi32(whole_lo));
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i chase8(__m256i x, __m256i step, __m256i target, __m256i half, __m256i limit) {
+    // target <= x - step moves back, otherwise target >= x + step moves forward
+    __m256i back = _mm256_andnot_si256(_mm256_cmpgt_epi32(target, _mm256_sub_epi32(x, step)), _mm256_set1_epi32(-1));
+    __m256i forward = _mm256_andnot_si256(back, _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(x, step), target), _mm256_set1_epi32(-1)));
+    x = _mm256_sub_epi32(x, _mm256_and_si256(back, step));
+    x = _mm256_add_epi32(x, _mm256_and_si256(forward, step));
+    return _mm256_min_epi32(_mm256_max_epi32(x, half), _mm256_sub_epi32(limit, half));
+}
+
+
+__attribute__((target("avx2")))
+static void chase_batch_avx2(MobBatch &b, int32_t xppos, int32_t yppos) {
+    const __m256i xtarget = _mm256_set1_epi32(xppos), ytarget = _mm256_set1_epi32(yppos);
+    const __m256i xlimit = _mm256_set1_epi32(SCREEN_WIDTH - 1), ylimit = _mm256_set1_epi32(SCREEN_HEIGHT - 1);
+    int32_t n = b.size(), i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i xstep = advance8(&b.xresidues[i], &b.xsteps[i]);
+        __m256i ystep = advance8(&b.yresidues[i], &b.ysteps[i]);
+        __m256i x = _mm256_loadu_si256((const __m256i*)&b.xs[i]);
+        __m256i y = _mm256_loadu_si256((const __m256i*)&b.ys[i]);
+        __m256i w2 = _mm256_loadu_si256((const __m256i*)&b.w2s[i]);
+        __m256i h2 = _mm256_loadu_si256((const __m256i*)&b.h2s[i]);
+        _mm256_storeu_si256((__m256i*)&b.xs[i], chase8(x, xstep, xtarget, w2, xlimit));
+        _mm256_storeu_si256((__m256i*)&b.ys[i], chase8(y, ystep, ytarget, h2, ylimit));
+    }
+    chase_range(b, i, n, xppos, yppos);
+}
+
+
+__attribute__((target("avx2")))
+static void bounce_batch_avx2(MobBatch &b) {
+    const __m256i xlimit = _mm256_set1_epi32(SCREEN_WIDTH - 1), ylimit = _mm256_set1_epi32(SCREEN_HEIGHT - 1);
+    int32_t n = b.size(), i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)&b.xs[i]), advance8(&b.xresidues[i], &b.xsteps[i]));
+        __m256i y = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)&b.ys[i]), advance8(&b.yresidues[i], &b.ysteps[i]));
+        __m256i w2 = _mm256_loadu_si256((const __m256i*)&b.w2s[i]);
+        __m256i h2 = _mm256_loadu_si256((const __m256i*)&b.h2s[i]);
+        __m256i xmax = _mm256_sub_epi32(xlimit, w2), ymax = _mm256_sub_epi32(ylimit, h2);
+        int xwall = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpgt_epi32(w2, x), _mm256_cmpgt_epi32(x, xmax))));
+        int ywall = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpgt_epi32(h2, y), _mm256_cmpgt_epi32(y, ymax))));
+        for (int32_t lane = 0; (xwall | ywall) >> lane; ++lane) {
+            if (xwall >> lane & 1) {
+                b.walls[i + lane] = X_WALL;
+            } else if (ywall >> lane & 1) {
+                b.walls[i + lane] = Y_WALL;
+            }
+        }
+        _mm256_storeu_si256((__m256i*)&b.xs[i], _mm256_min_epi32(_mm256_max_epi32(x, w2), xmax));
+        _mm256_storeu_si256((__m256i*)&b.ys[i], _mm256_min_epi32(_mm256_max_epi32(y, h2), ymax));
+    }
+    bounce_range(b, i, n);
+}
+
+
+static bool has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+
+void chase_batch(MobBatch &b, int32_t xppos, int32_t yppos) {
+    if (has_avx2()) {
+        chase_batch_avx2(b, xppos, yppos);
+    } else {
+        chase_batch_scalar(b, xppos, yppos);
+    }
+}
+
+
+void bounce_batch(MobBatch &b) {
+    if (has_avx2()) {
+        bounce_batch_avx2(b);
+    } else {
+        bounce_batch_scalar(b);
+    }
+}
+#else
+void chase_batch(MobBatch &b, int32_t xppos, int32_t yppos) {
+    chase_batch_scalar(b, xppos, yppos);
+}
+
+
+void bounce_batch(MobBatch &b) {
+    bounce_batch_scalar(b);
+}
+#endif
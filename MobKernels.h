@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+
+// Movement state of the mobs due for a step this frame, copied out of the entities so the
+// kernels below can work on eight of them at a time. Chasers and shooters use xstep and
+// ystep for their speed, bouncers for their direction.
+struct MobBatch {
+    std::vector<int32_t> index;
+    std::vector<int32_t> xs, ys;
+    std::vector<int32_t> w2s, h2s;
+    std::vector<double> xresidues, yresidues;
+    std::vector<double> xsteps, ysteps;
+    std::vector<uint8_t> walls;
+
+    void clear();
+    void push(int32_t i, int32_t x, int32_t y, int32_t w2, int32_t h2, double xresidue, double yresidue, double xstep, double ystep);
+    int32_t size() const {return index.size();}
+};
+
+
+enum {
+    X_WALL = 1,
+    Y_WALL = 2
+};
+
+
+// ChaserMob::act_main and AngleShooterMob::act_main for the whole batch.
+void chase_batch(MobBatch &b, int32_t xppos, int32_t yppos);
+void chase_batch_scalar(MobBatch &b, int32_t xppos, int32_t yppos);
+
+// The move of BouncerMob::act_main, walls gets X_WALL or Y_WALL for the mobs that hit one.
+// Turning around draws from the random stream of the bouncer and is left to the caller.
+void bounce_batch(MobBatch &b);
+void bounce_batch_scalar(MobBatch &b);
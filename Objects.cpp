@@ -1,83 +1,95 @@
-#define STB_IMAGE_IMPLEMENTATION
 #include "Objects.h"
 #include "Engine.h"
+#include "Parallel.h"
 #include <iostream>
 #include <cmath>
 #include <random>
 #include <algorithm>
-
-int32_t mob_map[SCREEN_HEIGHT][SCREEN_WIDTH] = {0};
-
-std::random_device rd;
-std::mt19937 gen(rd());
-std::uniform_real_distribution<double> udist(0., 1.);
-
-
-// Pixel 
-Pixel::Pixel(uint32_t color) {
-    r = color >> 16;
-    g = color >> 8;
-    b = color;
-    a = color >> 24;
-}
-
-
-Pixel Pixel::swap_colors() {
-    return Pixel(b, g, r, a);
-}
-
-
-uint32_t Pixel::pixel() const {
-    return (uint32_t(a) << 24) + (uint32_t(r) << 16) + (uint32_t(g) << 8) + b;
-}
-
-
-uint32_t Pixel::alpha_mix(Pixel color) {
-    uint32_t new_r, new_g, new_b;
-    new_r = uint32_t(r) * a / 255 + uint32_t(color.r) * (255 - a) / 255;
-    new_g = uint32_t(g) * a / 255 + uint32_t(color.g) * (255 - a) / 255;
-    new_b = uint32_t(b) * a / 255 + uint32_t(color.b) * (255 - a) / 255;
-    return 0xff000000 + (new_r << 16) + (new_g << 8) + new_b;
-}
-
-
-bool Pixel::is_color() const {
-    return uint32_t(r) + g + b;
+#include <mutex>
+#include <unordered_map>
+#include <type_traits>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+// Pixel buffers of destroyed textures are kept by size and handed to the next texture of that
+// size, so entities spawned in a running game reuse the buffers of the ones that died.
+// The cache is never destroyed, textures in other translation units may outlive it otherwise.
+struct PixelCache {
+    std::mutex mutex;
+    std::unordered_map<int, std::vector<Pixel*>> free_buffers;
+    int64_t live = 0, pooled = 0;
+};
+
+
+static PixelCache& pixel_cache() {
+    static PixelCache *cache = new PixelCache;
+    return *cache;
+}
+
+
+static Pixel* alloc_pixels(int n) {
+    PixelCache &cache = pixel_cache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        std::vector<Pixel*> &buffers = cache.free_buffers[n];
+        cache.live += n;
+        if (!buffers.empty()) {
+            Pixel *p = buffers.back();
+            buffers.pop_back();
+            cache.pooled -= n;
+            return p;
+        }
+    }
+    return new Pixel[n];
 }
 
 
-void Pixel::set_black(uint8_t alpha) {
-    if (!(this->is_color())) {
-        a = 0;
-    } else {
-        a = alpha;
+static void release_pixels(Pixel *p, int n) {
+    if (p == nullptr) {
+        return;
     }
+    PixelCache &cache = pixel_cache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.free_buffers[n].push_back(p);
+    cache.live -= n;
+    cache.pooled += n;
 }
 
 
 // Texture
 Texture::Texture(const char *path) {
-    data = (Pixel*)stbi_load(path, &width, &height, &channels, sizeof(Pixel));
-    rotdata = new Pixel[width * height];
+    Pixel *raw = decode_image(path, width, height, channels);
+    if (raw == nullptr) {
+        std::cerr << "cannot read texture " << path << std::endl;
+        return;
+    }
+    data = alloc_pixels(width * height);
+    rotdata = alloc_pixels(width * height);
     h2 = height / 2;
     w2 = width / 2;
     for (int i = 0; i < width * height; ++i) {
-        data[i] = data[i].swap_colors();
-        data[i].set_black(0xff);
-        rotdata[i] = data[i];
+        data[i] = rotdata[i] = raw[i];
     }
+    free_image(raw);
 }
 
 
-Texture::Texture(const Texture &c) {
+// Draws straight from pixels owned by someone else, a mapped pack. Such a texture is only
+// ever handed out const, rotating it would write to them. Copies get their own pixels.
+Texture::Texture(const Pixel *pixels, int width, int height, int channels):
+            data(const_cast<Pixel*>(pixels)), rotdata(const_cast<Pixel*>(pixels)), height(height), width(width),
+            channels(channels), h2(height / 2), w2(width / 2), owned(false) {}
+
+
+Texture::Texture(const Texture &c):
+            height(c.height), width(c.width), channels(c.channels), h2(c.h2), w2(c.w2),
+            tan2(c.tan2), sin(c.sin), theta(c.theta), next_theta(c.next_theta), rotatable(c.rotatable) {
     if (c.data != nullptr) {
-        height = c.height;
-        width = c.width;
-        channels = c.channels;
-        h2 = c.h2;
-        w2 = c.w2;
-        data = new Pixel[height * width];
-        rotdata = new Pixel[height * width];
+        data = alloc_pixels(height * width);
+        rotdata = alloc_pixels(height * width);
         for (int i = 0; i < height * width; ++i) {
             data[i] = c.data[i];
             rotdata[i] = c.rotdata[i];
@@ -87,99 +99,68 @@ Texture::Texture(const Texture &c) {
 
 
 Texture::Texture(Texture &&c) {
-    if (c.data != nullptr) {
-        data = c.data;
-        rotdata = c.rotdata;
-        c.rotdata = nullptr;
-        c.data = nullptr;
-        height = c.height;
-        width = c.width;
-        channels = c.channels;
-        h2 = c.h2;
-        w2 = c.w2;
-    }
+    swap(c);
 }
 
 
 Texture& Texture::operator=(const Texture &c) {
     if (&c != this) {
-        height = c.height;
-        width = c.width;
-        h2 = c.h2;
-        w2 = c.w2;
-        channels = c.channels;
-        data = new Pixel[height * width];
-        rotdata = new Pixel[height * width];
-        for (int i = 0; i < height * width; ++i) {
-            data[i] = c.data[i];
-            rotdata[i] = c.rotdata[i];
-        }
+        Texture tmp(c);
+        swap(tmp);
     }
     return *this;
 }
 
 
 Texture& Texture::operator=(Texture &&c) {
-    data = c.data;
-    rotdata = c.rotdata;
-    c.data = nullptr;
-    c.rotdata = nullptr;
-    height = c.height;
-    width = c.width;
-    h2 = c.h2;
-    w2 = c.w2;
-    channels = c.channels;
+    if (&c != this) {
+        Texture tmp(std::move(c));
+        swap(tmp);
+    }
     return *this;
 }
 
 
 Texture::~Texture() {
-    if (data != nullptr) {
-        free(data);
-    }
-    if (rotdata != nullptr) {
-        delete[] rotdata;
+    if (owned) {
+        release_pixels(data, width * height);
+        release_pixels(rotdata, width * height);
     }
 }
 
 
+void Texture::swap(Texture &c) {
+    std::swap(data, c.data);
+    std::swap(rotdata, c.rotdata);
+    std::swap(height, c.height);
+    std::swap(width, c.width);
+    std::swap(channels, c.channels);
+    std::swap(h2, c.h2);
+    std::swap(w2, c.w2);
+    std::swap(tan2, c.tan2);
+    std::swap(sin, c.sin);
+    std::swap(theta, c.theta);
+    std::swap(next_theta, c.next_theta);
+    std::swap(rotatable, c.rotatable);
+    std::swap(owned, c.owned);
+}
+
+
 void Texture::tighten_image() {
-    int imin = height, imax = 0, jmin = width, jmax = 0;
-    for (int i = 0; i < height; ++i) {
-        for (int j = 0; j < width; ++j) {
-            if (rotdata[i * width + j].is_color()) {
-                imax = i + 1;
-                if (imin > i) {
-                    imin = i;
-                }
-                if (jmax < j) {
-                    jmax = j + 1;
-                }
-                if (jmin > j) {
-                    jmin = j;
-                }
-            }
-        }
-    }
-    if (jmax - jmin <= 0 || imax - imin <= 0) {
+    std::vector<Pixel> tight;
+    int new_h, new_w;
+    if (!trim_image(rotdata, width, height, tight, new_w, new_h)) {
         return;
     }
-    int new_h = imax - imin + 2, new_w = jmax - jmin + 2;
-    Pixel *tight_data = new Pixel[new_h * new_w];
-    Pixel *tight_data2 = new Pixel[new_h * new_w];
-    for (int i = 0; i < height; ++i) {
-        int ioff = i - imin;
-        for (int j = 0; j < width; ++j) {
-            if (rotdata[i * width + j].is_color()) {
-                tight_data[ioff * new_w + j - jmin] = rotdata[i * width + j];
-                tight_data2[ioff * new_w + j - jmin] = rotdata[i * width + j];
-            }
-        }
+    if (owned) {
+        release_pixels(data, width * height);
+        release_pixels(rotdata, width * height);
     }
-    delete[] data;
-    delete[] rotdata;
-    data = tight_data;
-    rotdata = tight_data2;
+    data = alloc_pixels(new_h * new_w);
+    rotdata = alloc_pixels(new_h * new_w);
+    std::copy(tight.begin(), tight.end(), data);
+    std::copy(tight.begin(), tight.end(), rotdata);
+    owned = true;
     height = new_h;
     width = new_w;
     h2 = new_h / 2;
@@ -215,54 +196,8 @@ void Texture::calc_rotation_theta(double xdir, double ydir) {
 }
 
 
-void Texture::death_animation() {
-    Pixel *new_data = new Pixel[width * height];
-    for (int i = -h2; i < height - h2; ++i) {
-        double ti = tan2 * i;
-        for (int j = -w2; j < width - w2; ++j) {
-            if (data[(i + h2) * width + (j + h2)].is_color()) {
-                double jti = j - ti;
-                double sjti = sin * jti;
-                int32_t new_i = sjti + i;
-                int32_t new_j = jti - tan2 * sjti - ti;
-                if (new_i >= -h2 && new_j >= -h2 && new_i < height - h2 && new_j < width - h2) {
-                    new_data[(new_i + h2) * width + (new_j + w2)] = data[(i + h2) * width + (j + w2)];
-                }
-            }
-        }
-    }
-    delete[] data;
-    data = new_data;
-}
-
-
-void Texture::death_animation2(int32_t death_speed) {
-    for (int i = 0; i < height; ++i) {
-        for (int j = 0; j < width; ++j) {
-            if (data[i * width + j].is_color() && rand() % death_speed == 0) {
-                data[i * width + j].r = 0;
-                data[i * width + j].g = 0;
-                data[i * width + j].b = 0;
-                data[i * width + j].a = 0;
-            }
-        }
-    }
-}
-
-
 void Texture::vhflip_image() {
-    Pixel *newdata = new Pixel[width * height];
-    int vj = width - 1;
-    for (int i = 0; i < height; ++i) {
-        int vi = height - 1 - i;
-        for (int j = 0; j < width; ++j) {
-            if (data[i * width + j].is_color()) {
-                newdata[vi * width + vj - j] = data[i * width + j];
-            }
-        }
-    }
-    delete[] data;
-    data = newdata;
+    std::reverse(data, data + width * height);
 }
 
 
@@ -311,33 +246,168 @@ void Texture::rotate_image() {
 }
 
 
+// Texture Cache
+// two threads after the same texture may both decode it, the first one in keeps its copy
+const Texture& TextureCache::get(const char *path, bool tight) {
+    std::pair<std::string, bool> key(path, tight);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = textures.find(key);
+        if (found != textures.end()) {
+            return *found->second;
+        }
+    }
+    std::unique_ptr<Texture> loaded(new Texture(load_texture(path, tight)));
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Texture> &tex = textures[key];
+    if (tex == nullptr) {
+        if (loaded->get_w() == 0) {
+            ++missing;
+        } else {
+            decodes += loaded->is_owned();
+        }
+        tex = std::move(loaded);
+    }
+    return *tex;
+}
+
+
+void TextureCache::preload(const std::vector<TextureRequest> &requests, ThreadPool &pool) {
+    // one job per texture, the threads take them as they finish so a big image holds up only one
+    pool.run(requests.size(), [this, &requests](int32_t i) {
+        get(requests[i].path, requests[i].tight);
+    });
+}
+
+
+// the cached textures, then every pixel buffer in use including rotated frames and entity copies
+void TextureCache::report(std::ostream &out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t cached = 0;
+    for (const auto &entry: textures) {
+        int64_t bytes = 2 * int64_t(entry.second->get_w()) * entry.second->get_h() * sizeof(Pixel);
+        cached += bytes;
+        out << "texture " << entry.first.first << (entry.first.second ? " (tight) " : " ") << entry.second->get_w() << "x"
+            << entry.second->get_h() << " " << bytes / 1024 << " KiB" << std::endl;
+    }
+    PixelCache &pixels = pixel_cache();
+    std::lock_guard<std::mutex> pixels_lock(pixels.mutex);
+    out << "textures: " << decodes << " decoded, " << textures.size() - decodes - missing << " from the pack, " << missing << " missing, " << cached / 1024 << " KiB cached, " << pixels.live * sizeof(Pixel) / 1024
+        << " KiB in use, " << pixels.pooled * sizeof(Pixel) / 1024 << " KiB pooled" << std::endl;
+}
+
+
+Texture load_texture(const char *path, bool tight) {
+    if (const PackEntry *e = texture_pack().find(path, tight)) {
+        return Texture(texture_pack().pixels(*e), e->width, e->height, e->channels);
+    }
+    Texture tex(path);
+    if (tight) {
+        tex.tighten_image();
+    }
+    return tex;
+}
+
+
+TextureCache& texture_cache() {
+    static TextureCache *cache = new TextureCache;
+    return *cache;
+}
+
+
+// Sprite
+// the frames are independent, with a pool they are rotated on all its threads
+Sprite::Sprite(const Texture &tex, ThreadPool *pool): source(&tex), palette(new Palette(&tex[0], tex.get_w() * tex.get_h())) {
+    frames.resize(SPRITE_FRAMES);
+    auto rotate = [this, &tex](int32_t k) {
+        Texture rotated = tex;
+        if (k != 0) {
+            rotated.set_rotation_theta(2 * M_PI * k / SPRITE_FRAMES);
+            rotated.rotate_image();
+        }
+        frames[k] = IndexedTexture(&rotated[0], rotated.get_w(), rotated.get_h(), *palette);
+    };
+    if (pool != nullptr) {
+        pool->run(SPRITE_FRAMES, rotate);
+    } else {
+        for (int32_t k = 0; k < SPRITE_FRAMES; ++k) {
+            rotate(k);
+        }
+    }
+}
+
+
+const IndexedTexture& Sprite::frame(double angle) const {
+    return frames[std::lround(angle / (2 * M_PI) * SPRITE_FRAMES) % SPRITE_FRAMES];
+}
+
+
+size_t Sprite::bytes() const {
+    size_t total = palette->size() * (sizeof(Pixel) + sizeof(uint32_t));
+    for (const IndexedTexture &f: frames) {
+        total += f.bytes();
+    }
+    return total;
+}
+
+
 // BackGround
+#define TILE_ROW_PAD 8
+
 BackGround::BackGround(const char *s) {
-    int width, height, channels;
-    Pixel *data = (Pixel*)stbi_load(s, &width, &height, &channels, sizeof(Pixel));
-    for (int i = 0; i < width * height; ++i) {
-        data[i] = data[i].swap_colors();
-        data[i].set_black(0xff);
-    }
-    bheight = SCREEN_HEIGHT, bwidth = SCREEN_WIDTH;
-    int idx_i = 0, idx_j = 0;
-    for (int i = 0; i < bheight; ++i) {
-        idx_j = 0;
-        for (int j = 0; j < bwidth; ++j) {
-            background[i][j] = data[idx_i * width + idx_j];
-            idx_j = (idx_j + 1) % width;
+    Texture tile = load_texture(s);
+    tile_w = tile.get_w(), tile_h = tile.get_h();
+    row_len = tile_w + TILE_ROW_PAD;
+    rows.resize(row_len * tile_h);
+    for (int i = 0; i < tile_h; ++i) {
+        for (int j = 0; j < row_len; ++j) {
+            rows[i * row_len + j] = tile[i * tile_w + j % tile_w].pixel();
         }
-        idx_i = (idx_i + 1) % height;
     }
-    stbi_image_free(data);
 }
 
 
-BackGround::BackGround(const BackGround &c) {
-    bwidth = c.bwidth, bheight = c.bheight;
-    for (int i = 0; i < bheight; ++i) {
-        for (int j = 0; j < bwidth; ++j) {
-            background[i][j] = c.background[i][j];
+static void tile_row_scalar(uint32_t *dst, const uint32_t *row, int32_t width, int32_t start, int32_t tile_w) {
+    for (int32_t j = 0, s = start; j < width; ++j) {
+        dst[j] = row[s];
+        if (++s == tile_w) {
+            s = 0;
+        }
+    }
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void tile_row_avx2(uint32_t *dst, const uint32_t *row, int32_t width, int32_t start, int32_t tile_w) {
+    int32_t j = 0, s = start;
+    for (; j + 8 <= width; j += 8) {
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_loadu_si256((const __m256i*)(row + s)));
+        for (s += 8; s >= tile_w; s -= tile_w) {}
+    }
+    tile_row_scalar(dst + j, row, width - j, s, tile_w);
+}
+#endif
+
+
+static int32_t wrap(double offset, int32_t size) {
+    int32_t k = int32_t(std::floor(offset)) % size;
+    return k < 0 ? k + size : k;
+}
+
+
+void BackGround::draw(uint32_t *dst, int32_t width, int32_t height, int32_t pitch, double camera_x, double camera_y) const {
+    int32_t x0 = wrap(camera_x * parallax, tile_w), y0 = wrap(camera_y * parallax, tile_h);
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    auto tile_row = has_avx2 ? tile_row_avx2 : tile_row_scalar;
+#else
+    auto tile_row = tile_row_scalar;
+#endif
+    for (int32_t i = 0, k = y0; i < height; ++i) {
+        tile_row(dst + int64_t(i) * pitch, &rows[k * row_len], width, x0, tile_w);
+        if (++k == tile_h) {
+            k = 0;
         }
     }
 }
@@ -345,89 +415,41 @@ BackGround::BackGround(const BackGround &c) {
 
 // DeathBackGround
 DeathBackGround::DeathBackGround() {
-    int w, h, c, w2, h2;
-    Pixel *data1 = (Pixel*)stbi_load(spath, &w, &h, &c, sizeof(Pixel));
-    Pixel *data2 = (Pixel*)stbi_load(spath2, &w2, &h2, &c, sizeof(Pixel));
+    Texture data1 = load_texture(spath), data2 = load_texture(spath2);
+    int w = data1.get_w(), h = data1.get_h(), w2 = data2.get_w(), h2 = data2.get_h();
     int i0 = (SCREEN_HEIGHT - h) / 2;
     int j0 = (SCREEN_WIDTH - w - w2) / 2;
     for (int i = 0; i < h; ++i) {
         for (int j = 0; j < w; ++j) {
-            data1[i * w + j] = data1[i * w + j].swap_colors();
-            data1[i * w + j].set_black(0xff);
             background[i + i0][j + j0] = data1[i * w + j];
         }
     }
     for (int i = 0; i < h2; ++i) {
         for (int j = 0; j < w2; ++j) {
-            data2[i * w2 + j] = data2[i * w2 + j].swap_colors();
-            data2[i * w2 + j].set_black(0xff);
             background[i + i0][j + j0 + w2] = data2[i * w2 + j];
         }
     }
-    delete[] data1;
-    delete[] data2;
 }
 
 
 // Score
 Score::Score(int32_t score_len): score_len(score_len) {
-    zero.tighten_image();
-    one.tighten_image();
-    two.tighten_image();
-    three.tighten_image();
-    four.tighten_image();
-    five.tighten_image();
-    six.tighten_image();
-    seven.tighten_image();
-    eight.tighten_image();
-    nine.tighten_image();
+    char path[] = "textures/0.png";
+    for (int i = 0; i < 10; ++i) {
+        path[9] = '0' + i;
+        digits[i] = &texture_cache().get(path, true);
+    }
 }
 
 
 void Score::draw() {
-    int tmp_score = score;
-    int len = 0;
-    Texture draw_tex;
-    std::vector<int32_t> nums;
-    while (len != score_len) {
-        nums.push_back(tmp_score % 10);
-        tmp_score /= 10;
-        len++;
+    int32_t div = 1;
+    for (int i = 1; i < score_len; ++i) {
+        div *= 10;
     }
     int joff = 0;
-    for (int i = nums.size() - 1; i >= 0; --i) {
-        switch (nums[i]) {
-            case 0:
-                draw_tex = zero;
-                break;
-            case 1:
-                draw_tex = one;
-                break;
-            case 2:
-                draw_tex = two;
-                break;
-            case 3:
-                draw_tex = three;
-                break;
-            case 4:
-                draw_tex = four;
-                break;
-            case 5:
-                draw_tex = five;
-                break;
-            case 6:
-                draw_tex = six;
-                break;
-            case 7:
-                draw_tex = seven;
-                break;
-            case 8:
-                draw_tex = eight;
-                break;
-            case 9:
-                draw_tex = nine;
-                break;
-        }
+    for (int k = 0; k < score_len; ++k, div /= 10) {
+        const Texture &draw_tex = *digits[score / div % 10];
         for (int i = 0; i < draw_tex.get_h(); ++i) {
             for (int j = 0; j < draw_tex.get_w(); ++j) {
                 if (draw_tex[i * draw_tex.get_w() + j].is_color()) {
@@ -441,21 +463,12 @@ void Score::draw() {
 
 
 // Chaser
-ChaserMob::ChaserMob(double hp, int32_t score, int xpos, int ypos, double speed, int32_t upd_ms, Texture &tex, uint8_t alpha): 
-            hp(hp), score(score), xpos(xpos), ypos(ypos), speed(speed), upd_freq(upd_ms), tex(tex) {}
-
-
-void ChaserMob::deal_damage(double damage) {hp -= damage;}
-bool ChaserMob::is_dead() const {return hp <= 0;}
-double ChaserMob::get_hp() const {return hp;}
-int32_t ChaserMob::get_score() const {return score;}
-double ChaserMob::get_speed() const {return speed;}
-int ChaserMob::get_xpos() const {return xpos;}
-int ChaserMob::get_ypos() const {return ypos;}
+ChaserMob::ChaserMob(double hp, int32_t score, int xpos, int ypos, double speed, int32_t upd_ms, const Texture &tex, uint8_t alpha): 
+            Object(hp, score, speed, 0, xpos, ypos, tex), upd_freq(upd_ms) {}
 
 
 void ChaserMob::check_new() {
-    isnew = xpos < tex.get_w2() || xpos >= SCREEN_WIDTH - tex.get_w2() || ypos < tex.get_h2() || ypos >= SCREEN_HEIGHT - tex.get_h2();
+    isnew = xpos < tex->get_w2() || xpos >= SCREEN_WIDTH - tex->get_w2() || ypos < tex->get_h2() || ypos >= SCREEN_HEIGHT - tex->get_h2();
 }
 
 
@@ -473,8 +486,8 @@ void ChaserMob::act_main(int xppos, int yppos) {
     } else if (yppos >= ypos + yp1) {
         ypos += yp1;
     }
-    xpos = std::min(std::max(xpos, tex.get_w2()), SCREEN_WIDTH - 1 - tex.get_w2());
-    ypos = std::min(std::max(ypos, tex.get_h2()), SCREEN_HEIGHT - 1 - tex.get_h2());
+    xpos = std::min(std::max(xpos, tex->get_w2()), SCREEN_WIDTH - 1 - tex->get_w2());
+    ypos = std::min(std::max(ypos, tex->get_h2()), SCREEN_HEIGHT - 1 - tex->get_h2());
 }
 
 
@@ -495,68 +508,80 @@ void ChaserMob::act_new() {
 }
 
 
-void ChaserMob::act(int xppos, int yppos) {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    if (cur_time - timer > upd_freq) {
-        if (tex.is_rotatable()) {
-            tex.rotate_image();
-        }
+// Everything of an update except the move, true when act_main is due. The move itself
+// runs batched in Living_Objects::act, act() keeps the one mob version.
+bool ChaserMob::step_due(const FrameTime &t) {
+    bool due = false;
+    if (t.now - timer >= upd_freq) {
         if (isnew) {
             act_new();
             check_new();
         } else {
-            act_main(xppos, yppos);
+            due = true;
         }
-        timer = cur_time;
+        timer = t.now;
     }
+    return due;
 }
 
 
-int32_t ChaserMob::draw(int32_t mob_idx) {
-    int32_t pbullet_id = -1;
+void ChaserMob::act(const FrameTime &t, int xppos, int yppos) {
+    if (step_due(t)) {
+        act_main(xppos, yppos);
+    }
+}
+
+
+void ChaserMob::gather(MobBatch &b, int32_t i) const {
+    b.push(i, xpos, ypos, tex->get_w2(), tex->get_h2(), xresidue, yresidue, speed, speed);
+}
+
+
+void ChaserMob::scatter(const MobBatch &b, int32_t k) {
+    xpos = b.xs[k], ypos = b.ys[k];
+    xresidue = b.xresidues[k], yresidue = b.yresidues[k];
+}
+
+
+void ChaserMob::draw(double alpha) {
+    int x = draw_xpos(alpha), y = draw_ypos(alpha);
     int di = 0, dj = 0;
-    for (int i = ypos - tex.get_h2(); i < ypos + tex.get_h2(); ++i, ++di) {
+    for (int i = y - tex->get_h2(); i < y + tex->get_h2(); ++i, ++di) {
         if (i < 0 || i >= SCREEN_HEIGHT) {
             continue;
         }
         dj = 0;
-        for (int j = xpos - tex.get_w2(); j < xpos + tex.get_w2(); ++j, ++dj) {
+        for (int j = x - tex->get_w2(); j < x + tex->get_w2(); ++j, ++dj) {
             if (j < 0 || j >= SCREEN_WIDTH) {
                 continue;
             }
-            buffer[i][j] = tex[di * tex.get_w() + dj].alpha_mix(buffer[i][j]);
-            if(tex[di * tex.get_w() + dj].is_color()) {
-                if ((mob_map[i][j] & MOBS_CODE) == 0 && mob_map[i][j] != 0) {       //Pbullet here
-                    pbullet_id = mob_map[i][j];
-                }
-                mob_map[i][j] = mob_idx;
-            }
+            buffer[i][j] = (*tex)[di * tex->get_w() + dj].alpha_mix(buffer[i][j]);
         }
     }
-    return pbullet_id;
 }
 
 
 // Bouncer
-BouncerMob::BouncerMob(double hp, int32_t score, int xpos, int ypos, double xdir, double ydir, int32_t upd_ms, Texture &tex, uint8_t alpha): 
-            hp(hp), score(score), xpos(xpos), ypos(ypos), xdir(xdir), ydir(ydir), upd_freq(upd_ms), tex(tex) {
-    if (udist(gen) > 0.3) {
-        this->tex.set_rotation_theta(M_PI / 8 * udist(gen));
-    }
+BouncerMob::BouncerMob(double hp, int32_t score, int xpos, int ypos, double xdir, double ydir, int32_t upd_ms, const Sprite &sprite, uint8_t alpha, const Rng &rng): 
+            Object(hp, score, 0, 0, xpos, ypos, sprite.get_source()), sprite(&sprite), upd_freq(upd_ms) {
+    launch(xdir, ydir, rng);
 }
 
 
-void BouncerMob::deal_damage(double damage) {hp -= damage;}
-bool BouncerMob::is_dead() const {return hp <= 0;}
-double BouncerMob::get_hp() const {return hp;}
-int32_t BouncerMob::get_score() const {return score;}
-double BouncerMob::get_speed() const {return speed;}
-int BouncerMob::get_xpos() const {return xpos;}
-int BouncerMob::get_ypos() const {return ypos;}
+// most bouncers spin, the turn per step is rolled on their own stream
+void BouncerMob::launch(double xdir, double ydir, const Rng &rng) {
+    this->xdir = xdir, this->ydir = ydir;
+    this->rng = rng;
+    angle = spin = 0;
+    frame = &sprite->frame(0);
+    if (this->rng.uniform() > 0.3) {
+        spin = M_PI / 8 * this->rng.uniform();
+    }
+}
 
 
 void BouncerMob::check_new() {
-    isnew = xpos < tex.get_w2() || xpos >= SCREEN_WIDTH - tex.get_w2() || ypos < tex.get_h2() || ypos >= SCREEN_HEIGHT - tex.get_h2();
+    isnew = xpos < tex->get_w2() || xpos >= SCREEN_WIDTH - tex->get_w2() || ypos < tex->get_h2() || ypos >= SCREEN_HEIGHT - tex->get_h2();
 }
 
 
@@ -566,13 +591,13 @@ void BouncerMob::act_main(int xppos, int yppos) {
     xresidue -= xp1, yresidue -= yp1;
     xpos += xp1;
     ypos += yp1;
-    if (xpos < tex.get_w2() || xpos > SCREEN_WIDTH - 1 - tex.get_w2()) {
-        xdir = -xdir * (rand() * acc_modifier + 0.9);
-    } else if (ypos < tex.get_h2() || ypos > SCREEN_HEIGHT - 1 - tex.get_h2()) {
-        ydir = -ydir * (rand() * acc_modifier + 0.9);
+    if (xpos < tex->get_w2() || xpos > SCREEN_WIDTH - 1 - tex->get_w2()) {
+        xdir = -xdir * (rng.uniform() * acc_modifier + 0.9);
+    } else if (ypos < tex->get_h2() || ypos > SCREEN_HEIGHT - 1 - tex->get_h2()) {
+        ydir = -ydir * (rng.uniform() * acc_modifier + 0.9);
     }
-    xpos = std::min(std::max(xpos, tex.get_w2()), SCREEN_WIDTH - 1 - tex.get_w2());
-    ypos = std::min(std::max(ypos, tex.get_h2()), SCREEN_HEIGHT - 1 - tex.get_h2());
+    xpos = std::min(std::max(xpos, tex->get_w2()), SCREEN_WIDTH - 1 - tex->get_w2());
+    ypos = std::min(std::max(ypos, tex->get_h2()), SCREEN_HEIGHT - 1 - tex->get_h2());
 }
 
 
@@ -594,11 +619,12 @@ void BouncerMob::act_new() {
 }
 
 
-void BouncerMob::act(int xppos, int yppos) {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    if (cur_time - timer > upd_freq) {
-        if (tex.is_rotatable()) {
-            tex.rotate_image();
+bool BouncerMob::step_due(const FrameTime &t) {
+    bool due = false;
+    if (t.now - timer >= upd_freq) {
+        if (spin != 0) {
+            angle = std::fmod(angle + spin, 2 * M_PI);
+            frame = &sprite->frame(angle);
         }
         if (isnew) {
             act_new();
@@ -607,50 +633,45 @@ void BouncerMob::act(int xppos, int yppos) {
                 xresidue = yresidue = 0;
             }
         } else {
-            act_main(xppos, yppos);
+            due = true;
         }
-        timer = cur_time;
+        timer = t.now;
     }
+    return due;
 }
 
 
-int32_t BouncerMob::draw(int32_t mob_idx) {
-    int32_t pbullet_id = -1;
-    int di = 0, dj = 0;
-    for (int i = ypos - tex.get_h2(); i < ypos + tex.get_h2(); ++i, ++di) {
-        if (i < 0 || i >= SCREEN_HEIGHT) {
-            continue;
-        }
-        dj = 0;
-        for (int j = xpos - tex.get_w2(); j < xpos + tex.get_w2(); ++j, ++dj) {
-            if (j < 0 || j >= SCREEN_WIDTH) {
-                continue;
-            }
-            buffer[i][j] = tex[di * tex.get_w() + dj].alpha_mix(buffer[i][j]);
-            if (tex[di * tex.get_w() + dj].is_color()) {
-                if ((mob_map[i][j] & MOBS_CODE) == 0 && mob_map[i][j] != 0) {
-                    pbullet_id = mob_map[i][j];
-                }
-                mob_map[i][j] = mob_idx;
-            }
-        }
+void BouncerMob::act(const FrameTime &t, int xppos, int yppos) {
+    if (step_due(t)) {
+        act_main(xppos, yppos);
     }
-    return pbullet_id;
 }
 
 
-// Shooter
-AngleShooterMob::AngleShooterMob(double hp, int32_t score, int xpos, int ypos, double speed, double bspeed, int32_t upd_ms, int32_t bullet_ms, Texture &tex, Texture &btex, uint8_t alpha): 
-            hp(hp), score(score), xpos(xpos), ypos(ypos), speed(speed), upd_freq(upd_ms), tex(tex), bullet(btex), bullet_ms(bullet_ms), bspeed(bspeed) {}
+void BouncerMob::gather(MobBatch &b, int32_t i) const {
+    b.push(i, xpos, ypos, tex->get_w2(), tex->get_h2(), xresidue, yresidue, xdir, ydir);
+}
 
 
-void AngleShooterMob::deal_damage(double damage) {hp -= damage;}
-bool AngleShooterMob::is_dead() const {return hp <= 0;}
-double AngleShooterMob::get_hp() const {return hp;}
-int32_t AngleShooterMob::get_score() const {return score;}
-double AngleShooterMob::get_speed() const {return speed;}
-int AngleShooterMob::get_xpos() const {return xpos;}
-int AngleShooterMob::get_ypos() const {return ypos;}
+void BouncerMob::scatter(const MobBatch &b, int32_t k) {
+    xpos = b.xs[k], ypos = b.ys[k];
+    xresidue = b.xresidues[k], yresidue = b.yresidues[k];
+    if (b.walls[k] == X_WALL) {
+        xdir = -xdir * (rng.uniform() * acc_modifier + 0.9);
+    } else if (b.walls[k] == Y_WALL) {
+        ydir = -ydir * (rng.uniform() * acc_modifier + 0.9);
+    }
+}
+
+
+void BouncerMob::draw(double alpha) {
+    frame->draw(draw_xpos(alpha), draw_ypos(alpha));
+}
+
+
+// Shooter
+AngleShooterMob::AngleShooterMob(double hp, int32_t score, int xpos, int ypos, double speed, double bspeed, int32_t upd_ms, int32_t bullet_ms, const Texture &tex, const Texture &btex, uint8_t alpha): 
+            Object(hp, score, speed, 0, xpos, ypos, tex), bspeed(bspeed), bullet(&btex), upd_freq(upd_ms), bullet_ms(bullet_ms) {}
 
 
 void AngleShooterMob::act_main(int xppos, int yppos) {
@@ -667,8 +688,8 @@ void AngleShooterMob::act_main(int xppos, int yppos) {
     } else if (yppos >= ypos + yp1) {
         ypos += yp1;
     }
-    xpos = std::min(std::max(xpos, tex.get_w2()), SCREEN_WIDTH - 1 - tex.get_w2());
-    ypos = std::min(std::max(ypos, tex.get_h2()), SCREEN_HEIGHT - 1 - tex.get_h2());
+    xpos = std::min(std::max(xpos, tex->get_w2()), SCREEN_WIDTH - 1 - tex->get_w2());
+    ypos = std::min(std::max(ypos, tex->get_h2()), SCREEN_HEIGHT - 1 - tex->get_h2());
 }
 
 
@@ -689,211 +710,577 @@ void AngleShooterMob::act_new() {
 }
 
 
-void AngleShooterMob::act(int xppos, int yppos) {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    if (cur_time - timer > upd_freq) {
-        if (tex.is_rotatable()) {
-            tex.rotate_image();
-        }
+bool AngleShooterMob::step_due(const FrameTime &t) {
+    bool due = false;
+    if (t.now - timer >= upd_freq) {
         if (isnew) {
             act_new();
             check_new();
         } else {
-            act_main(xppos, yppos);
-            if (cur_time - bullet_timer > bullet_ms) {
-                ready_to_shoot = true;
-                bullet_timer = cur_time;
-            }
+            due = true;
         }
-        timer = cur_time;
+        timer = t.now;
     }
+    return due;
+}
+
+
+void AngleShooterMob::act(const FrameTime &t, int xppos, int yppos) {
+    if (step_due(t)) {
+        act_main(xppos, yppos);
+    }
+}
+
+
+void AngleShooterMob::gather(MobBatch &b, int32_t i) const {
+    b.push(i, xpos, ypos, tex->get_w2(), tex->get_h2(), xresidue, yresidue, speed, speed);
+}
+
+
+void AngleShooterMob::scatter(const MobBatch &b, int32_t k) {
+    xpos = b.xs[k], ypos = b.ys[k];
+    xresidue = b.xresidues[k], yresidue = b.yresidues[k];
 }
 
 
-int32_t AngleShooterMob::draw(int32_t mob_idx) {
-    int32_t pbullet_id = -1;
+void AngleShooterMob::draw(double alpha) {
+    int x = draw_xpos(alpha), y = draw_ypos(alpha);
     int di = 0, dj = 0;
-    for (int i = ypos - tex.get_h2(); i < ypos + tex.get_h2(); ++i, ++di) {
+    for (int i = y - tex->get_h2(); i < y + tex->get_h2(); ++i, ++di) {
         if (i < 0 || i >= SCREEN_HEIGHT) {
             continue;
         }
         dj = 0;
-        for (int j = xpos - tex.get_w2(); j < xpos + tex.get_w2(); ++j, ++dj) {
+        for (int j = x - tex->get_w2(); j < x + tex->get_w2(); ++j, ++dj) {
             if (j < 0 || j >= SCREEN_WIDTH) {
                 continue;
             }
-            buffer[i][j] = tex[di * tex.get_w() + dj].alpha_mix(buffer[i][j]);
-            if (tex[di * tex.get_w() + dj].is_color()) {
-                if ((mob_map[i][j] & MOBS_CODE) == 0 && mob_map[i][j] != 0) {
-                    pbullet_id = mob_map[i][j];
-                }
-                mob_map[i][j] = mob_idx;
-            }
+            buffer[i][j] = (*tex)[di * tex->get_w() + dj].alpha_mix(buffer[i][j]);
         }
     }
-    return pbullet_id;
 }
 
 
-Object* AngleShooterMob::attack(int xppos, int yppos) {
+void AngleShooterMob::attack(int xppos, int yppos, CommandBuffer &commands) {
     if (ready_to_shoot) {
         ready_to_shoot = false;
-        Object *b = new PlayerBullet(damage, bspeed, xppos - xpos, yppos - ypos, xpos, ypos, bullet, 10);
-        return b;
+        commands.spawn_projectile(MOB_OWNER, damage, bspeed, xppos - xpos, yppos - ypos, xpos, ypos, *bullet);
     }
-    return nullptr;
 }
 
 
 void AngleShooterMob::check_new() {
-    isnew = xpos < tex.get_w2() || xpos >= SCREEN_WIDTH - tex.get_w2() || ypos < tex.get_h2() || ypos >= SCREEN_HEIGHT - tex.get_h2();
+    isnew = xpos < tex->get_w2() || xpos >= SCREEN_WIDTH - tex->get_w2() || ypos < tex->get_h2() || ypos >= SCREEN_HEIGHT - tex->get_h2();
+}
+
+
+// Command Buffer
+template <class T>
+static void append_all(std::vector<T> &to, std::vector<T> &from) {
+    for (T &e: from) {
+        to.push_back(std::move(e));
+    }
+    from.clear();
+}
+
+
+void CommandBuffer::reserve(int32_t nchasers, int32_t nbouncers, int32_t nshooters) {
+    chasers.reserve(chasers.size() + nchasers);
+    bouncers.reserve(bouncers.size() + nbouncers);
+    shooters.reserve(shooters.size() + nshooters);
+}
+
+
+void CommandBuffer::append(CommandBuffer &other) {
+    append_all(chasers, other.chasers);
+    append_all(bouncers, other.bouncers);
+    append_all(shooters, other.shooters);
+    append_all(buffs, other.buffs);
+    append_all(projectiles, other.projectiles);
+    append_all(despawns, other.despawns);
+    append_all(buff_grants, other.buff_grants);
+}
+
+
+void CommandBuffer::clear() {
+    chasers.clear();
+    bouncers.clear();
+    shooters.clear();
+    buffs.clear();
+    projectiles.clear();
+    despawns.clear();
+    buff_grants.clear();
 }
 
 
 // Living Objects
-void Living_Objects::remake_vectors() {
-    std::vector<Object*> tmp, tmp2, tmp3;
-    for (int i = 0; i < objects.size(); ++i) {
-        if (objects[i] != nullptr) {
-            tmp.push_back(objects[i]);
+template <class T>
+static void remove_dead(SlotMap<T> &entities) {
+    for (int32_t i = 0; i < entities.size();) {
+        if (entities[i].is_dead()) {
+            entities.erase_at(i);
+        } else {
+            ++i;
         }
     }
-    for (int i = 0; i < pbullets.size(); ++i) {
-        if (pbullets[i] != nullptr) {
-            tmp2.push_back(pbullets[i]);
+}
+
+
+template <class T, class F>
+static void for_each_live(SlotMap<T> &entities, int32_t type, F fn) {
+    entities.for_each([&](int32_t i, T &e) {
+        if (!e.is_dead()) {
+            fn(entity_id(type, i), e);
         }
-    }
-    for (int i = 0; i < buffs.size(); ++i) {
-        if (buffs[i] != nullptr) {
-            tmp3.push_back(pbullets[i]);
+    });
+}
+
+
+template <class T>
+static void draw_live(SlotMap<T> &entities, double alpha) {
+    entities.for_each([alpha](int32_t, T &e) {
+        if (!e.is_dead()) {
+            e.draw(alpha);
         }
+    });
+}
+
+
+template <class T>
+static void report_pool(std::ostream &out, const char *name, const T &entities) {
+    out << name << ": high water " << entities.get_high_water() << " of " << entities.get_capacity();
+    if (entities.get_refused() > 0) {
+        out << ", " << entities.get_refused() << " spawns refused";
     }
-    objects = tmp;
-    pbullets = tmp2;
-    buffs = tmp3;
+    out << std::endl;
 }
 
 
-void Living_Objects::add(Object *obj) {
-    objects.push_back(obj);
+void Living_Objects::remove_dead() {
+    ::remove_dead(chasers);
+    ::remove_dead(bouncers);
+    ::remove_dead(shooters);
+    projectiles.compact();
+    ::remove_dead(buffs);
 }
 
 
-void Living_Objects::add_pbullet(Object *obj) {
-    pbullets.push_back(obj);
+int32_t Living_Objects::size() const {
+    return chasers.size() + bouncers.size() + shooters.size() + buffs.size() + projectiles.size();
 }
 
 
-int32_t Living_Objects::act(int xppos, int yppos) {
-    for (int i = 0; i < objects.size(); ++i) {
-        if (objects[i] != nullptr) {
-            objects[i]->act(xppos, yppos);
-            if (objects[i]->is_dead()) {
-                collected_buffs.push_back(objects[i]->get_score());
-            }
-            Object* new_mob = objects[i]->attack(xppos, yppos);
-            if (new_mob != nullptr) {
-                add(new_mob);
+int32_t Living_Objects::count_of(int32_t type) const {
+    switch (type) {
+        case CHASER_TYPE:
+            return chasers.size();
+        case BOUNCER_TYPE:
+            return bouncers.size();
+        case SHOOTER_TYPE:
+            return shooters.size();
+        case MOB_BULLET_TYPE:
+            return projectiles.count_owned(MOB_OWNER);
+        default:
+            return buffs.size();
+    }
+}
+
+
+void Living_Objects::position_of(int32_t id, int &x, int &y) const {
+    int32_t i = entity_index(id);
+    switch (entity_type(id)) {
+        case CHASER_TYPE:
+            x = chasers[i].get_xpos(), y = chasers[i].get_ypos();
+            break;
+        case BOUNCER_TYPE:
+            x = bouncers[i].get_xpos(), y = bouncers[i].get_ypos();
+            break;
+        case SHOOTER_TYPE:
+            x = shooters[i].get_xpos(), y = shooters[i].get_ypos();
+            break;
+        case MOB_BULLET_TYPE:
+            x = projectiles.get_xpos(i), y = projectiles.get_ypos(i);
+            break;
+        default:
+            x = buffs[i].get_xpos(), y = buffs[i].get_ypos();
+    }
+}
+
+
+Object* Living_Objects::get(int32_t id) {
+    int32_t i = entity_index(id);
+    switch (entity_type(id)) {
+        case CHASER_TYPE:
+            return &chasers[i];
+        case BOUNCER_TYPE:
+            return &bouncers[i];
+        case SHOOTER_TYPE:
+            return &shooters[i];
+        default:
+            return &buffs[i];
+    }
+}
+
+
+EntityHandle Living_Objects::handle(int32_t id) const {
+    int32_t i = entity_index(id);
+    switch (entity_type(id)) {
+        case CHASER_TYPE:
+            return {CHASER_TYPE, chasers.handle_of(i)};
+        case BOUNCER_TYPE:
+            return {BOUNCER_TYPE, bouncers.handle_of(i)};
+        case SHOOTER_TYPE:
+            return {SHOOTER_TYPE, shooters.handle_of(i)};
+        case MOB_BULLET_TYPE:
+            return EntityHandle();
+        default:
+            return {BUFF_TYPE, buffs.handle_of(i)};
+    }
+}
+
+
+// nullptr once the entity has been removed, even if its slot went to a new one
+Object* Living_Objects::get(const EntityHandle &h) {
+    switch (h.type) {
+        case CHASER_TYPE:
+            return chasers.get(h.handle);
+        case BOUNCER_TYPE:
+            return bouncers.get(h.handle);
+        case SHOOTER_TYPE:
+            return shooters.get(h.handle);
+        case BUFF_TYPE:
+            return buffs.get(h.handle);
+        default:
+            return nullptr;
+    }
+}
+
+
+void Living_Objects::report_pools(std::ostream &out) const {
+    report_pool(out, "chasers", chasers);
+    report_pool(out, "bouncers", bouncers);
+    report_pool(out, "shooters", shooters);
+    report_pool(out, "projectiles", projectiles);
+    report_pool(out, "buffs", buffs);
+}
+
+
+// An update only reads the player position and writes the entity itself,
+// so chunks of one type can run on the pool threads at the same time. A chunk copies
+// the mobs due for a move into its batch, moves them all with the kernel and copies back.
+// A chunk holds at least ACT_MIN_TASK mobs, about 75 us of work, so waking a worker pays off,
+// and a type with fewer mobs than that is moved on the calling thread.
+template <class T, class Kernel>
+void Living_Objects::act_chunks(const FrameTime &t, SlotMap<T> &entities, Kernel kernel) {
+    ThreadPool &threads = workers();
+    if (int32_t(chunk_batches.size()) < threads.size()) {
+        chunk_batches.resize(threads.size());
+    }
+    threads.parallel_for(entities.size(), ACT_MIN_TASK, [this, &t, &entities, &kernel](int32_t begin, int32_t end, int32_t chunk) {
+        MobBatch &b = chunk_batches[chunk];
+        b.clear();
+        for (int32_t i = begin; i < end; ++i) {
+            entities[i].save_position();
+            if (entities[i].step_due(t)) {
+                entities[i].gather(b, i);
             }
         }
+        kernel(b);
+        for (int32_t k = 0; k < b.size(); ++k) {
+            entities[b.index[k]].scatter(b, k);
+        }
+    });
+}
+
+
+// a chunk records into its own buffer, the buffers are appended in chunk order afterwards
+// so the spawns come out in the same order whatever the thread count
+void Living_Objects::act_shooters(const FrameTime &t, int xppos, int yppos) {
+    ThreadPool &threads = workers();
+    if (int32_t(chunk_commands.size()) < threads.size()) {
+        chunk_commands.resize(threads.size());
     }
-    for (int i = 0; i < pbullets.size(); ++i) {
-        if (pbullets[i] != nullptr) {
-            pbullets[i]->act(xppos, yppos);
+    act_chunks(t, shooters, [xppos, yppos](MobBatch &b) {chase_batch(b, xppos, yppos);});
+    threads.parallel_for(shooters.size(), ACT_MIN_TASK, [this, xppos, yppos](int32_t begin, int32_t end, int32_t chunk) {
+        for (int32_t i = begin; i < end; ++i) {
+            shooters[i].attack(xppos, yppos, chunk_commands[chunk]);
         }
+    });
+    for (CommandBuffer &chunk: chunk_commands) {
+        commands.append(chunk);
     }
-    return objects.size();
 }
 
 
-int32_t Living_Objects::draw() {
-    int32_t score = 0;
-    if (num_deleted > 400) {
-        remake_vectors();
-        num_deleted = 0;
+int32_t Living_Objects::act(const FrameTime &t, int xppos, int yppos) {
+    // the fire timer of a removed shooter is dropped when it comes due
+    timers.advance(t.frame, [this](const TimerEvent &e) {
+        AngleShooterMob *m = shooters.get(e.target);
+        if (m == nullptr) {
+            return false;
+        }
+        m->ready_to_shoot = !m->isnew;
+        return true;
+    });
+    act_chunks(t, chasers, [xppos, yppos](MobBatch &b) {chase_batch(b, xppos, yppos);});
+    act_chunks(t, bouncers, [](MobBatch &b) {bounce_batch(b);});
+    act_shooters(t, xppos, yppos);
+    projectiles.act(t);
+    buffs.for_each([&](int32_t, Buff &b) {
+        b.act(xppos, yppos);
+        if (b.is_dead()) {
+            commands.grant_buff(b.get_buff_type());
+        }
+    });
+    return size();
+}
+
+
+template <class T>
+static void move_into(std::vector<T> &spawned, SlotMap<T> &entities) {
+    for (T &e: spawned) {
+        entities.insert(std::move(e));
     }
-    for (int i = 0; i < buffs.size(); ++i) {
-        if (buffs[i] == nullptr) {
-            continue;
+    spawned.clear();
+}
+
+
+// The sync point of a frame. Entities killed during the frame are erased, the recorded
+// spawns are inserted in bulk, buffs go to the player and the spatial index is rebuilt
+// over the entities the next frame starts with.
+void Living_Objects::apply_commands(Player &p) {
+    for (const EntityHandle &h: commands.despawns) {
+        if (Object *e = get(h)) {
+            e->hp = 0;
         }
-        if (buffs[i]->is_dead()) {
-            delete buffs[i];
-            buffs[i] = nullptr;
-            num_deleted++;
-        } else {
-            buffs[i]->draw(i);
+    }
+    remove_dead();
+    move_into(commands.chasers, chasers);
+    move_into(commands.bouncers, bouncers);
+    for (AngleShooterMob &m: commands.shooters) {
+        uint32_t period = steps_of(m.bullet_ms);
+        Handle h = shooters.insert(std::move(m));
+        if (shooters.contains(h)) {
+            timers.schedule(period, period, {SHOOT_TIMER, h});
         }
     }
-    for (int i = 0; i < pbullets.size(); ++i) {
-        if (pbullets[i] == nullptr) {
-            continue;
+    commands.shooters.clear();
+    move_into(commands.buffs, buffs);
+    for (const ProjectileSpawn &s: commands.projectiles) {
+        projectiles.spawn(s);
+    }
+    for (int32_t buff: commands.buff_grants) {
+        if ((buff & HP_BUFF_CODE) == HP_BUFF_CODE) {
+            p.add_hp(1);
+        } else if ((buff & DAMAGE_BUFF_CODE) == DAMAGE_BUFF_CODE) {
+            p.add_damage(1);
         }
-        if (pbullets[i]->is_dead()) {
-            delete pbullets[i];
-            pbullets[i] = nullptr;
-            num_deleted++;
-        } else {
-             pbullets[i]->draw(i);
+    }
+    commands.clear();
+    build_index();
+}
+
+
+void Living_Objects::build_index() {
+    index.clear();
+    auto insert = [this](int32_t id, const Object &e) {
+        index.insert(id, e.get_xpos(), e.get_ypos(), e.get_w2(), e.get_h2());
+    };
+    for_each_live(chasers, CHASER_TYPE, insert);
+    for_each_live(bouncers, BOUNCER_TYPE, insert);
+    for_each_live(shooters, SHOOTER_TYPE, insert);
+    projectiles.for_each(MOB_OWNER, [this](int32_t i) {
+        index.insert(entity_id(MOB_BULLET_TYPE, i), projectiles.get_xpos(i), projectiles.get_ypos(i), projectiles.get_w2(i), projectiles.get_h2(i));
+    });
+    for_each_live(buffs, BUFF_TYPE, insert);
+    index.build();
+}
+
+
+// Pixel exact test of two sprites drawn centered at the given positions
+template <class A, class B>
+static bool sprites_overlap(const A &a, int ax, int ay, const B &b, int bx, int by) {
+    int i0 = std::max(std::max(ay - a.get_h2(), by - b.get_h2()), 0);
+    int i1 = std::min(std::min(ay + a.get_h2(), by + b.get_h2()), SCREEN_HEIGHT);
+    int j0 = std::max(std::max(ax - a.get_w2(), bx - b.get_w2()), 0);
+    int j1 = std::min(std::min(ax + a.get_w2(), bx + b.get_w2()), SCREEN_WIDTH);
+    for (int i = i0; i < i1; ++i) {
+        int ai = (i - ay + a.get_h2()) * a.get_w() - ax + a.get_w2();
+        int bi = (i - by + b.get_h2()) * b.get_w() - bx + b.get_w2();
+        for (int j = j0; j < j1; ++j) {
+            if (a[ai + j].is_color() && b[bi + j].is_color()) {
+                return true;
+            }
         }
     }
-    for (int i = 0; i < objects.size(); ++i) {
-        if (objects[i] == nullptr) {
+    return false;
+}
+
+
+// the lower category comes first in a contact, the player has no index and goes as -1
+enum {
+    PLAYER_CATEGORY = 1,
+    PBULLET_CATEGORY = 2,
+    OBJECT_CATEGORY = 4
+};
+
+
+template <class Broadphase>
+void Living_Objects::find_contacts(Broadphase &broadphase, Player &p) {
+    broadphase.clear();
+    auto insert = [this, &broadphase](int32_t id, const Object &e) {
+        broadphase.insert(id, e.get_xpos(), e.get_ypos(), e.get_w2(), e.get_h2());
+    };
+    for_each_live(chasers, CHASER_TYPE, insert);
+    for_each_live(bouncers, BOUNCER_TYPE, insert);
+    for_each_live(shooters, SHOOTER_TYPE, insert);
+    projectiles.for_each(MOB_OWNER, [this, &broadphase](int32_t i) {
+        broadphase.insert(entity_id(MOB_BULLET_TYPE, i), projectiles.get_xpos(i), projectiles.get_ypos(i), projectiles.get_w2(i), projectiles.get_h2(i));
+    });
+    broadphase.build();
+    if (!p.is_dead()) {
+        broadphase.within_box(AABB::centered(p.get_xpos(), p.get_ypos(), p.get_tex().get_w2(), p.get_tex().get_h2()), candidates);
+        for (int32_t id: candidates) {
+            contacts.push_back({-1, id});
+        }
+    }
+    projectiles.for_each(PLAYER_OWNER, [this, &broadphase](int32_t i) {
+        broadphase.within_box(AABB::centered(projectiles.get_xpos(i), projectiles.get_ypos(i), projectiles.get_w2(i), projectiles.get_h2(i)), candidates);
+        for (int32_t id: candidates) {
+            contacts.push_back({i, id});
+        }
+    });
+}
+
+
+void Living_Objects::find_contacts_sweep(Player &p) {
+    sweep.clear();
+    auto insert = [this](int32_t id, const Object &e) {
+        sweep.insert(id, OBJECT_CATEGORY, 0, e.get_xpos(), e.get_ypos(), e.get_w2(), e.get_h2());
+    };
+    for_each_live(chasers, CHASER_TYPE, insert);
+    for_each_live(bouncers, BOUNCER_TYPE, insert);
+    for_each_live(shooters, SHOOTER_TYPE, insert);
+    for (int32_t i = 0; i < projectiles.size(); ++i) {
+        if (!projectiles.is_alive(i)) {
             continue;
         }
-        if (objects[i]->is_dead()) {
-            delete objects[i];
-            objects[i] = nullptr;
-            num_deleted++;
+        if (projectiles.get_owner(i) == MOB_OWNER) {
+            sweep.insert(entity_id(MOB_BULLET_TYPE, i), OBJECT_CATEGORY, 0, projectiles.get_xpos(i), projectiles.get_ypos(i), projectiles.get_w2(i), projectiles.get_h2(i));
         } else {
-            int32_t pbid = objects[i]->draw(i | MOBS_CODE);
-            if (pbid != -1) {
-                objects[i]->deal_damage(pbullets[pbid]->get_damage());
-                pbullets[pbid]->deal_damage(1.0);
-                if (objects[i]->is_dead()) {
-                    score += objects[i]->get_score();
-                }
-            }
+            sweep.insert(i, PBULLET_CATEGORY, OBJECT_CATEGORY, projectiles.get_xpos(i), projectiles.get_ypos(i), projectiles.get_w2(i), projectiles.get_h2(i));
         }
     }
-    return score;
+    if (!p.is_dead()) {
+        sweep.insert(-1, PLAYER_CATEGORY, OBJECT_CATEGORY, p.get_xpos(), p.get_ypos(), p.get_tex().get_w2(), p.get_tex().get_h2());
+    }
+    sweep.find_pairs(contacts, workers());
 }
 
 
-void Living_Objects::give_buffs(Player &p) {
-    for (int i = collected_buffs.size() - 1; i >= 0; --i) {
-        int32_t buff = collected_buffs[i];
-        collected_buffs.pop_back();
-        if ((buff & HP_BUFF_CODE) == HP_BUFF_CODE) {
-            p.add_hp(1);
-        } else if ((buff & DAMAGE_BUFF_CODE) == DAMAGE_BUFF_CODE) {
-            p.add_damage(1);
-        }
+// a mob drawn with look against the player, or against the player bullet other when it is not -1
+template <class T>
+bool Living_Objects::mob_overlaps(int32_t other, const T &look, int x, int y, const Player &p) const {
+    if (other == -1) {
+        return sprites_overlap(look, x, y, p.get_tex(), p.get_xpos(), p.get_ypos());
     }
+    return sprites_overlap(look, x, y, projectiles.get_tex(other), projectiles.get_xpos(other), projectiles.get_ypos(other));
 }
 
 
-Living_Objects::~Living_Objects() {
-    for (int i = 0; i < objects.size(); ++i) {
-        if (objects[i] != nullptr)
-            delete objects[i];
+int32_t Living_Objects::collide(const FrameTime &t, Player &p) {
+    int32_t score = 0;
+    contacts.clear();
+    // the grid tests fewer boxes until the mobs pile up, see GW_BENCH=broadphase
+    if (size() > SWEEP_THRESHOLD) {
+        find_contacts_sweep(p);
+    } else if (index.crowding() > QUADTREE_CROWDING) {
+        find_contacts(tree, p);
+    } else {
+        find_contacts(grid, p);
+    }
+    // hits are resolved in the same order whichever broadphase found them
+    std::sort(contacts.begin(), contacts.end());
+    touching.assign(contacts.size(), 0);
+    workers().parallel_for(contacts.size(), 256, [this, &p](int32_t begin, int32_t end, int32_t) {
+        for (int32_t k = begin; k < end; ++k) {
+            int32_t id = contacts[k].second;
+            if (entity_type(id) == MOB_BULLET_TYPE) {
+                int32_t i = entity_index(id);
+                if (contacts[k].first == -1) {
+                    touching[k] = sprites_overlap(projectiles.get_tex(i), projectiles.get_xpos(i), projectiles.get_ypos(i), p.get_tex(), p.get_xpos(), p.get_ypos());
+                }
+                continue;
+            }
+            if (entity_type(id) == BOUNCER_TYPE) {
+                const BouncerMob &m = bouncers[entity_index(id)];
+                touching[k] = mob_overlaps(contacts[k].first, *m.frame, m.get_xpos(), m.get_ypos(), p);
+            } else {
+                const Object *m = get(id);
+                touching[k] = mob_overlaps(contacts[k].first, m->get_tex(), m->get_xpos(), m->get_ypos(), p);
+            }
+        }
+    });
+    // one hit per mob and frame, flags laid out chasers, bouncers, shooters
+    hit_mobs.assign(chasers.size() + bouncers.size() + shooters.size(), 0);
+    int32_t hit_offset[3] = {0, chasers.size(), chasers.size() + bouncers.size()};
+    bool player_hit = false;
+    for (int32_t k = 0; k < int32_t(contacts.size()); ++k) {
+        if (!touching[k]) {
+            continue;
+        }
+        if (contacts[k].first == -1) {
+            if (!player_hit) {
+                p.hit(t);
+                player_hit = true;
+            }
+            continue;
+        }
+        Object *m = get(contacts[k].second);
+        uint8_t &hit = hit_mobs[hit_offset[entity_type(contacts[k].second)] + entity_index(contacts[k].second)];
+        int32_t b = contacts[k].first;
+        if (!hit && !m->is_dead() && projectiles.is_alive(b)) {
+            m->deal_damage(projectiles.get_damage(b));
+            projectiles.kill(b);
+            hit = 1;
+            if (m->is_dead()) {
+                score += m->get_score();
+                ++kills;
+            }
+        }
     }
+    return score;
+}
+
+
+void Living_Objects::draw(double alpha) {
+    draw_live(buffs, alpha);
+    projectiles.draw(PLAYER_OWNER, alpha);
+    draw_live(bouncers, alpha);
+    draw_live(chasers, alpha);
+    draw_live(shooters, alpha);
+    projectiles.draw(MOB_OWNER, alpha);
 }
 
 
 // Player
 Player::Player(double speed, double shoot_speed_ms, double damage, double xpos, double ypos, double xdir, double ydir, const char *path, const char *bpath):
-            speed(speed), shoot_speed_ms(shoot_speed_ms), damage(damage), xpos(xpos), ypos(ypos), xdir(xdir), ydir(ydir) {
-    tex = Texture(path);
-    bullet_tex = Texture(bpath);
-    for (int i = 0; i < nums.size(); ++i) {
-        nums[i].tighten_image();
+            speed(speed), shoot_speed_ms(shoot_speed_ms), damage(damage), xpos(xpos), ypos(ypos), prev_xpos(xpos), prev_ypos(ypos), xdir(xdir), ydir(ydir) {
+    tex = texture_cache().get(path);
+    bullet_tex = &texture_cache().get(bpath);
+    char num_path[] = "textures/0.png";
+    for (int i = 0; i < 10; ++i) {
+        num_path[9] = '0' + i;
+        nums[i] = &texture_cache().get(num_path, true);
     }
+    texhp = &texture_cache().get("textures/health.png");
+    texdmg = &texture_cache().get("textures/speed.png");
 }
 
 
-void Player::act() {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    if (cur_time - timer > upd_freq) {
+void Player::act(const FrameTime &t) {
+    prev_xpos = xpos, prev_ypos = ypos;
+    if (t.now - timer >= upd_freq) {
         tex.calc_rotation_theta(xdir, ydir);
         tex.add_rotation_theta(M_PI);
         tex.rotate_image();
@@ -901,51 +1288,58 @@ void Player::act() {
         ypos += yspeed * speed;
         xpos = std::min(std::max(xpos, tex.get_w2()), SCREEN_WIDTH - 1 - tex.get_w2());
         ypos = std::min(std::max(ypos, tex.get_h2()), SCREEN_HEIGHT - 1 - tex.get_h2());
-        timer = cur_time;
+        timer = t.now;
         xspeed = 0;
         yspeed = 0;
     }
 }
 
 
-void Player::draw() {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+void Player::hit(const FrameTime &t) {
+    if (t.now - last_damage_time > 1000) {
+        hp--;
+        last_damage_time = t.now;
+    }
+}
+
+
+void Player::draw(double alpha) {
+    int x = lerp_position(prev_xpos, xpos, alpha), y = lerp_position(prev_ypos, ypos, alpha);
     int di = 0, dj = 0;
-    for (int i = ypos - tex.get_h2(); i < ypos + tex.get_h2(); ++i, ++di) {
+    for (int i = y - tex.get_h2(); i < y + tex.get_h2(); ++i, ++di) {
+        if (i < 0 || i >= SCREEN_HEIGHT) {
+            continue;
+        }
         dj = 0;
-        for (int j = xpos - tex.get_w2(); j < xpos + tex.get_w2(); ++j, ++dj) {
-            buffer[i][j] = tex[di * tex.get_w() + dj].alpha_mix(buffer[i][j]);
-            if(tex[di * tex.get_w() + dj].is_color()) {
-                if (cur_time - last_damage_time > 1000 && (mob_map[i][j] & MOBS_CODE)) {
-                    hp--;
-                    last_damage_time = cur_time;
-                }
+        for (int j = x - tex.get_w2(); j < x + tex.get_w2(); ++j, ++dj) {
+            if (j < 0 || j >= SCREEN_WIDTH) {
+                continue;
             }
+            buffer[i][j] = tex[di * tex.get_w() + dj].alpha_mix(buffer[i][j]);
         }
     }
 }
 
 
 void Player::draw_stats() {
-    int jwrite = SCREEN_WIDTH - texhp.get_w() - 1;
-    for (int i = 0; i < texhp.get_h(); ++i) {
-        for (int j = jwrite; j < jwrite + texhp.get_w(); ++j) {
-            buffer[i][j] = texhp[i * texhp.get_w() + j - jwrite].alpha_mix(buffer[i][j]);
+    int jwrite = SCREEN_WIDTH - texhp->get_w() - 1;
+    for (int i = 0; i < texhp->get_h(); ++i) {
+        for (int j = jwrite; j < jwrite + texhp->get_w(); ++j) {
+            buffer[i][j] = (*texhp)[i * texhp->get_w() + j - jwrite].alpha_mix(buffer[i][j]);
         }
     }
-    jwrite -= nums[hp].get_w() + 1;
-    for (int i = 0; i < nums[hp].get_h(); ++i) {
-        for (int j = jwrite; j < jwrite + nums[hp].get_w(); ++j) {
-            buffer[i][j] = nums[hp][i * nums[hp].get_w() + j - jwrite].alpha_mix(buffer[i][j]);
+    jwrite -= nums[hp]->get_w() + 1;
+    for (int i = 0; i < nums[hp]->get_h(); ++i) {
+        for (int j = jwrite; j < jwrite + nums[hp]->get_w(); ++j) {
+            buffer[i][j] = (*nums[hp])[i * nums[hp]->get_w() + j - jwrite].alpha_mix(buffer[i][j]);
         }
     }
 }
 
 
-bool Player::can_shoot() {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    if (cur_time - last_shot_time > shoot_speed_ms) {
-        last_shot_time = cur_time;
+bool Player::can_shoot(const FrameTime &t) {
+    if (t.now - last_shot_time > shoot_speed_ms) {
+        last_shot_time = t.now;
         return true;
     }
     return false;
@@ -954,197 +1348,225 @@ bool Player::can_shoot() {
 
 // Buff
 void Buff::act(int xppos, int yppos) {
-    if (std::abs(xppos - xpos) <= tex.get_w2() && std::abs(yppos - ypos) <= tex.get_h2()) {
+    if (std::abs(xppos - xpos) <= tex->get_w2() && std::abs(yppos - ypos) <= tex->get_h2()) {
         hp = -1;
     }
 }
 
 
-int32_t Buff::draw(int32_t mob_idx) {
+void Buff::draw(double alpha) {
+    int x = draw_xpos(alpha), y = draw_ypos(alpha);
     int di = 0, dj = 0;
-    for (int i = ypos - tex.get_h2(); i < ypos + tex.get_h2(); ++i, ++di) {
+    for (int i = y - tex->get_h2(); i < y + tex->get_h2(); ++i, ++di) {
         if (i < 0 || i >= SCREEN_HEIGHT) {
             continue;
         }
         dj = 0;
-        for (int j = xpos - tex.get_w2(); j < xpos + tex.get_w2(); ++j, ++dj) {
+        for (int j = x - tex->get_w2(); j < x + tex->get_w2(); ++j, ++dj) {
             if (j < 0 || j >= SCREEN_WIDTH) {
                 continue;
             }
-            buffer[i][j] = tex[di * tex.get_w() + dj].alpha_mix(buffer[i][j]);
+            buffer[i][j] = (*tex)[di * tex->get_w() + dj].alpha_mix(buffer[i][j]);
         }
     }
-    return -1;
 }
 
 
-// Player Bullet
-PlayerBullet::PlayerBullet(double damage, double speed, double xdir, double ydir, int32_t xpos, int32_t ypos, Texture &tex, int32_t upd_freq):
-            damage(damage), speed(speed), xdir(xdir), ydir(ydir), xpos(xpos), ypos(ypos), tex(tex), upd_freq(upd_freq) {
-    sdir = std::sqrt(xdir * xdir + ydir * ydir);
-    this->xdir /= sdir;
-    this->ydir /= sdir;
-    this->tex.calc_rotation_theta(xdir, ydir);
-    this->tex.rotate_image();
+// Mob Creator
+// side picks the edge with odds by its length, along is the position on it from 0 to 1
+void MobCreator::edge_point(double side, double along, const Texture &tex, int32_t &xpos, int32_t &ypos) const {
+    if (side < aspect_res_x) {
+        xpos = -tex.get_w();
+        ypos = along * SCREEN_HEIGHT;
+    } else if (side < aspect_res_x * 2) {
+        xpos = tex.get_w() + SCREEN_WIDTH;
+        ypos = along * SCREEN_HEIGHT;
+    } else if (side < aspect_res_x * 2 + aspect_res_y) {
+        ypos = -tex.get_h();
+        xpos = along * SCREEN_WIDTH;
+    } else {
+        ypos = tex.get_h() + SCREEN_HEIGHT;
+        xpos = along * SCREEN_WIDTH;
+    }
 }
 
 
-void PlayerBullet::act(int32_t xppos, int32_t yppos) {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    if (cur_time - timer > upd_freq) {
-        xresidue += xdir * speed, yresidue += ydir * speed;
-        int32_t xp1 = int32_t(xresidue), yp1 = int32_t(yresidue);
-        xresidue -= xp1, yresidue -= yp1;
-        xpos += xp1;
-        ypos += yp1;
-        if (xpos < tex.get_w2() || xpos > SCREEN_WIDTH - 1 - tex.get_w2() || ypos < tex.get_h2() || ypos > SCREEN_HEIGHT - 1 - tex.get_h2()) {
-            hp = -1.0;
+// every formation starts off the screen, the mobs walk in on their own
+void MobCreator::place(const Placement &p, const Texture &tex, int32_t &xpos, int32_t &ypos) {
+    switch (p.formation) {
+        case RING_FORMATION: {
+            double angle = 2 * M_PI * (p.k + p.anchor) / p.n;
+            double radius = std::hypot(SCREEN_WIDTH, SCREEN_HEIGHT) / 2 + std::max(tex.get_w(), tex.get_h()) + p.spread;
+            xpos = SCREEN_WIDTH / 2 + radius * std::cos(angle);
+            ypos = SCREEN_HEIGHT / 2 + radius * std::sin(angle);
+            break;
+        }
+        case LINE_FORMATION:
+            edge_point(p.anchor, (p.k + 0.5) / p.n, tex, xpos, ypos);
+            break;
+        case CLUSTER_FORMATION:
+            edge_point(p.anchor, 0.5, tex, xpos, ypos);
+            xpos += (rng.uniform() * 2 - 1) * p.spread;
+            ypos += (rng.uniform() * 2 - 1) * p.spread;
+            break;
+        default: {
+            double side = rng.uniform();
+            edge_point(side, rng.uniform(), tex, xpos, ypos);
         }
-        timer = cur_time;
     }
 }
 
 
-int32_t PlayerBullet::draw(int32_t mob_idx) {
-    int di = 0, dj = 0;
-    for (int i = ypos - tex.get_h2(); i < ypos + tex.get_h2(); ++i, ++di) {
-        dj = 0;
-        for (int j = xpos - tex.get_w2(); j < xpos + tex.get_w2(); ++j, ++dj) {
-            buffer[i][j] = tex[di * tex.get_w() + dj].alpha_mix(buffer[i][j]);
-            if(tex[di * tex.get_w() + dj].is_color()) {
-                mob_map[i][j] = mob_idx;
-            }
-        }
-    }
-    return -1;
+// The stats come with the prototype, the copy only gets where it enters and when.
+template <class T>
+static T spawn_copy(const T &prototype, int32_t xpos, int32_t ypos) {
+    static_assert(std::is_trivially_copyable<T>::value, "prototypes are copied as plain records");
+    T mob = prototype;
+    mob.xpos = mob.prev_xpos = xpos;
+    mob.ypos = mob.prev_ypos = ypos;
+    mob.timer = frame_now();
+    return mob;
 }
 
 
-// Mob Creator
-Object* MobCreator::create_bouncer() {
-    double rand_rate = udist(gen) * multiplier;
-    double hp = 1 + hp_rate * rand_rate;
-    double score = 1 + score_rate * rand_rate;
-    double radius_split = udist(gen);
-    int32_t xsign = (udist(gen) > 0.5 ? -1 : 1);
-    int32_t ysign = (udist(gen) > 0.5 ? -1 : 1);
-    int32_t tex_id = int(udist(gen) * bouncer_enemies.size());
-    double spawn_loc = udist(gen);
+BouncerMob MobCreator::create_bouncer(double level, const Placement &p) {
+    int32_t tier = rng.uniform() * level * TIERS_PER_LEVEL;
+    int32_t tex_id = int(rng.uniform() * bouncer_enemies.size());
+    const BouncerMob &prototype = bouncer_prototypes.get(tex_id, tier, [this, tex_id](double rate) {
+        double hp = 1 + hp_rate * rate;
+        double score = 1 + score_rate * rate;
+        return BouncerMob(hp, score, 0, 0, 0, 0, 10, bouncer_sprites[tex_id], 255, Rng());
+    });
     int32_t xpos, ypos;
-    if (spawn_loc < aspect_res_x) {
-        xpos = -bouncer_enemies[tex_id].get_w();
-        ypos = udist(gen) * SCREEN_HEIGHT;
-    } else if (spawn_loc < aspect_res_x * 2) {
-        xpos = bouncer_enemies[tex_id].get_w() + SCREEN_WIDTH;
-        ypos = udist(gen) * SCREEN_HEIGHT;
-    } else if (spawn_loc < aspect_res_x * 2 + aspect_res_y) {
-        ypos = -bouncer_enemies[tex_id].get_h();
-        xpos = udist(gen) * SCREEN_WIDTH;
-    } else {
-        ypos = bouncer_enemies[tex_id].get_h() + SCREEN_HEIGHT;
-        xpos = udist(gen) * SCREEN_WIDTH;
-    }
-    double xdir = (udist(gen) > 0.5 ? -1 : 1) * udist(gen) * speed_rate * multiplier;
-    double ydir = (udist(gen) > 0.5 ? -1 : 1) * std::sqrt(1 - xdir * xdir) * speed_rate * multiplier;
-    Object* bouncer = new BouncerMob(hp, score, xpos, ypos, xdir, ydir, 10, bouncer_enemies[tex_id], 255);
-    return bouncer;
-    return nullptr;
-}
-
-
-Object* MobCreator::create_chaser() {
-    double rand_rate = udist(gen) * multiplier;
-    double hp = 1 + hp_rate * rand_rate;
-    int32_t score = 1 + score_rate * rand_rate;
-    double speed = 1 + speed_rate * rand_rate;
-    double radius_split = udist(gen);
-    int32_t xsign = (udist(gen) > 0.5 ? -1 : 1);
-    int32_t ysign = (udist(gen) > 0.5 ? -1 : 1);
-    int32_t tex_id = int(udist(gen) * chaser_enemies.size());
-    double spawn_loc = udist(gen);
+    place(p, *bouncer_enemies[tex_id], xpos, ypos);
+    double xunit = (rng.uniform() > 0.5 ? -1 : 1) * rng.uniform();
+    double xdir = xunit * speed_rate * level;
+    double ydir = (rng.uniform() > 0.5 ? -1 : 1) * std::sqrt(1 - xunit * xunit) * speed_rate * level;
+    BouncerMob mob = spawn_copy(prototype, xpos, ypos);
+    mob.launch(xdir, ydir, rng.split());
+    return mob;
+}
+
+
+ChaserMob MobCreator::create_chaser(double level, const Placement &p) {
+    int32_t tier = rng.uniform() * level * TIERS_PER_LEVEL;
+    int32_t tex_id = int(rng.uniform() * chaser_enemies.size());
+    const ChaserMob &prototype = chaser_prototypes.get(tex_id, tier, [this, tex_id](double rate) {
+        double hp = 1 + hp_rate * rate;
+        int32_t score = 1 + score_rate * rate;
+        double speed = 1 + speed_rate * rate;
+        return ChaserMob(hp, score, 0, 0, speed, 10, *chaser_enemies[tex_id], 255);
+    });
     int32_t xpos, ypos;
-    if (spawn_loc < aspect_res_x) {
-        xpos = -chaser_enemies[tex_id].get_w();
-        ypos = udist(gen) * SCREEN_HEIGHT;
-    } else if (spawn_loc < aspect_res_x * 2) {
-        xpos = chaser_enemies[tex_id].get_w() + SCREEN_WIDTH;
-        ypos = udist(gen) * SCREEN_HEIGHT;
-    } else if (spawn_loc < aspect_res_x * 2 + aspect_res_y) {
-        ypos = -chaser_enemies[tex_id].get_h();
-        xpos = udist(gen) * SCREEN_WIDTH;
-    } else {
-        ypos = chaser_enemies[tex_id].get_h() + SCREEN_HEIGHT;
-        xpos = udist(gen) * SCREEN_WIDTH;
-    }
-    Object* chaser = new ChaserMob(hp, score, xpos, ypos, speed, 10, chaser_enemies[tex_id], 255);
-    return chaser;
-    return nullptr;
+    place(p, *chaser_enemies[tex_id], xpos, ypos);
+    return spawn_copy(prototype, xpos, ypos);
 }
 
 
-Object* MobCreator::create_shooter() {
-    double rand_rate = udist(gen) * multiplier;
-    double hp = std::max(hp_rate * rand_rate, 1.);
-    int32_t score = 5 + score_rate * rand_rate;
-    double speed = std::max(speed_rate * rand_rate * 0.5, 1.);
-    double radius_split = udist(gen);
-    int32_t xsign = (udist(gen) > 0.5 ? -1 : 1);
-    int32_t ysign = (udist(gen) > 0.5 ? -1 : 1);
-    int32_t tex_id = int(udist(gen) * shooters.size());
-    double spawn_loc = udist(gen);
+AngleShooterMob MobCreator::create_shooter(double level, const Placement &p) {
+    int32_t tier = rng.uniform() * level * TIERS_PER_LEVEL;
+    int32_t tex_id = int(rng.uniform() * shooters.size());
+    const AngleShooterMob &prototype = shooter_prototypes.get(tex_id, tier, [this, tex_id](double rate) {
+        double hp = std::max(hp_rate * rate, 1.);
+        int32_t score = 5 + score_rate * rate;
+        double speed = std::max(speed_rate * rate * 0.5, 1.);
+        return AngleShooterMob(hp, score, 0, 0, speed, speed * 1.5, 10, 1000, *shooters[tex_id], *shooter_bullets[tex_id], 255);
+    });
     int32_t xpos, ypos;
-    if (spawn_loc < aspect_res_x) {
-        xpos = -shooters[tex_id].get_w();
-        ypos = udist(gen) * SCREEN_HEIGHT;
-    } else if (spawn_loc < aspect_res_x * 2) {
-        xpos = shooters[tex_id].get_w() + SCREEN_WIDTH;
-        ypos = udist(gen) * SCREEN_HEIGHT;
-    } else if (spawn_loc < aspect_res_x * 2 + aspect_res_y) {
-        ypos = -shooters[tex_id].get_h();
-        xpos = udist(gen) * SCREEN_WIDTH;
-    } else {
-        ypos = shooters[tex_id].get_h() + SCREEN_HEIGHT;
-        xpos = udist(gen) * SCREEN_WIDTH;
-    }
-    Object* shooter = new AngleShooterMob(hp, score, xpos, ypos, speed, speed * 1.5, 10, 1000, shooters[tex_id], shooter_bullets[tex_id], 255);
-    return shooter;
-    return nullptr;
+    place(p, *shooters[tex_id], xpos, ypos);
+    return spawn_copy(prototype, xpos, ypos);
 }
 
 
-Object* MobCreator::create_buff() {
-    int32_t buff_type = buff_codes[int32_t(udist(gen) * buff_codes.size())];
-    int32_t xpos = udist(gen) * (SCREEN_WIDTH - 2 * buffs[0].get_w()) + buffs[0].get_w();
-    int32_t ypos = udist(gen) * (SCREEN_HEIGHT - 2 * buffs[0].get_h()) + buffs[0].get_h();
-    Object *buff = new Buff(buff_type, xpos, ypos, buffs[0]);
-    return buff;
+Buff MobCreator::create_buff() {
+    int32_t buff_type = buff_codes[int32_t(rng.uniform() * buff_codes.size())];
+    int32_t xpos = rng.uniform() * (SCREEN_WIDTH - 2 * buffs[0]->get_w()) + buffs[0]->get_w();
+    int32_t ypos = rng.uniform() * (SCREEN_HEIGHT - 2 * buffs[0]->get_h()) + buffs[0]->get_h();
+    return Buff(buff_type, xpos, ypos, *buffs[0]);
 }
 
-Object* MobCreator::create_random_mob() {
-    if (udist(gen) > 0.97) {
-        return create_buff();
+void MobCreator::create_random_mob(Living_Objects &objects) {
+    if (rng.uniform() > 0.97) {
+        objects.get_commands().spawn(create_buff());
+        return;
     }
-    switch (int(udist(gen) * 3) % 3) {
+    switch (int(rng.uniform() * 3) % 3) {
         case 0:
-            return create_bouncer();
+            objects.get_commands().spawn(create_bouncer());
+            break;
         case 1:
-            return create_chaser();
+            objects.get_commands().spawn(create_chaser());
+            break;
         default:
-            return create_shooter();
+            objects.get_commands().spawn(create_shooter());
     }
 }
 
 
-Object* MobCreator::act(int nmobs) {
-    int64_t cur_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    if (cur_time - timer > upd_ms) {
-        multiplier += 1.;
-        create_chance += 0.01;
-        timer = cur_time;
+// The whole wave goes into the command buffer in one call and enters at the next sync point.
+void MobCreator::spawn_wave(const Wave &w, double level, Living_Objects &objects) {
+    CommandBuffer &commands = objects.get_commands();
+    commands.reserve(w.chasers, w.bouncers, w.shooters);
+    Placement p;
+    p.formation = w.formation;
+    p.n = std::max(w.chasers + w.bouncers + w.shooters, 1);
+    p.spread = w.spread;
+    p.anchor = rng.uniform();
+    for (int32_t i = 0; i < w.chasers; ++i, ++p.k) {
+        commands.spawn(create_chaser(level, p));
     }
-    if (cur_time - mob_timer > mob_create_ms && udist(gen) < create_chance) {
-        mob_timer = cur_time;
-        return create_random_mob();
+    for (int32_t i = 0; i < w.bouncers; ++i, ++p.k) {
+        commands.spawn(create_bouncer(level, p));
+    }
+    for (int32_t i = 0; i < w.shooters; ++i, ++p.k) {
+        commands.spawn(create_shooter(level, p));
+    }
+}
+
+
+// waves are timed from the start of the game, a repeating table reschedules each wave by itself
+bool MobCreator::load_waves(const char *path, std::ostream &err) {
+    if (!load_wave_table(path, table, err)) {
+        return false;
+    }
+    wave_rounds.assign(table.waves.size(), 0);
+    for (int32_t i = 0; i < int32_t(table.waves.size()); ++i) {
+        int64_t delay = std::max<int64_t>(table.waves[i].at_ms - frame_now(), 0);
+        timers.schedule(steps_of(delay), steps_of(table.repeat_ms), {WAVE_TIMER, Handle{uint32_t(i), 0}});
+    }
+    return true;
+}
+
+
+MobCreator::MobCreator(double hp_rate, double speed_rate, double score_rate, int64_t upd_ms, int64_t mob_create_ms, ThreadPool *pool):
+            hp_rate(hp_rate), speed_rate(speed_rate), upd_ms(upd_ms), mob_create_ms(mob_create_ms), score_rate(score_rate) {
+    for (const Texture *tex: bouncer_enemies) {
+        bouncer_sprites.emplace_back(*tex, pool);
+    }
+    timers.schedule(steps_of(upd_ms), steps_of(upd_ms), {RAMP_TIMER, Handle()});
+    timers.schedule(steps_of(mob_create_ms), 0, {SPAWN_TIMER, Handle()});
+}
+
+
+// once the spawn interval is up every step rolls for a mob until one comes, then it starts over
+void MobCreator::act(const FrameTime &t, Living_Objects &objects) {
+    timers.advance(t.frame, [this, &objects](const TimerEvent &e) {
+        if (e.kind == RAMP_TIMER) {
+            multiplier += 1.;
+            create_chance += 0.01;
+        } else if (e.kind == WAVE_TIMER) {
+            const Wave &w = table.waves[e.target.slot];
+            spawn_wave(w, w.level + wave_rounds[e.target.slot]++ * table.level_step, objects);
+        } else {
+            spawn_due = true;
+        }
+        return true;
+    });
+    if (spawn_due && rng.uniform() < create_chance) {
+        spawn_due = false;
+        timers.schedule(steps_of(mob_create_ms), 0, {SPAWN_TIMER, Handle()});
+        for (int32_t i = 0; i < burst; ++i) {
+            create_random_mob(objects);
+        }
     }
-    return nullptr;
 }
\ No newline at end of file
@@ -1,55 +1,58 @@
 #pragma once
 
-#include "stb_image.h"
 #include "Engine.h"
+#include "Pixel.h"
+#include "IndexedTexture.h"
+#include "TexturePack.h"
+#include "Spatial.h"
+#include "SlotMap.h"
+#include "Parallel.h"
+#include "Projectiles.h"
+#include "MobKernels.h"
+#include "FrameClock.h"
+#include "TimerWheel.h"
+#include "Random.h"
+#include "Waves.h"
 #include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <cmath>
 #include <chrono>
-#include <random>
 
-#define MOBS_CODE 0xf00000
 #define HP_BUFF_CODE 0xc000000
 #define DAMAGE_BUFF_CODE 0x3000000
-
-extern int32_t mob_map[SCREEN_HEIGHT][SCREEN_WIDTH];
-extern std::uniform_real_distribution<double> udist;
-extern std::mt19937 gen;
-
-
-struct Pixel {
-    uint8_t b = 0;
-    uint8_t g = 0;
-    uint8_t r = 0;
-    uint8_t a = 0;
-
-    Pixel(){}
-    Pixel(uint8_t r, uint8_t g, uint8_t b, uint8_t a): r(r), g(g), b(b), a(a) {}
-    Pixel(uint32_t color);
-    Pixel swap_colors();
-    uint32_t pixel() const;
-    uint32_t alpha_mix(Pixel color);
-    bool is_color() const;
-    void set_black(uint8_t alpha);
-};
-
+#define SWEEP_THRESHOLD 4096
+#define QUADTREE_CROWDING 80
+#define TYPE_SHIFT 24
+#define MOB_POOL_CAPACITY 4096
+#define BUFF_POOL_CAPACITY 256
+#define ACT_MIN_TASK 2048
+#define SPRITE_FRAMES 64
+#define TIERS_PER_LEVEL 4
 
 class Texture {
     private:
     Pixel *data = nullptr;
     Pixel *rotdata = nullptr;
-    int height, width, channels;
-    int h2, w2;
+    int height = 0, width = 0, channels = 0;
+    int h2 = 0, w2 = 0;
     double tan2 = 0.0, sin = 0.0;
     double theta = 0.0;
     double next_theta = 0.0;
     bool rotatable = false;
+    bool owned = true;
 
     void vhflip_image();
     void _rotate_image(double angle);
+    void swap(Texture &c);
     public:
 
     Texture(){}
     Texture(const char *path);
+    Texture(const Pixel *pixels, int width, int height, int channels);
     Texture(const Texture &c);
     Texture(Texture &&c);
     Texture& operator=(const Texture &c);
@@ -57,29 +60,77 @@ class Texture {
     ~Texture();
 
     Pixel& operator[](const int i) {return data[i];}
+    const Pixel& operator[](const int i) const {return data[i];}
     int get_h() const {return height;}
     int get_h2() const {return h2;}
     int get_w() const {return width;}
     int get_w2() const {return w2;}
     int get_c() const {return channels;}
     bool is_rotatable() const {return rotatable;}
+    bool is_owned() const {return owned;}
     void add_rotation_theta(double angle);
     void set_rotation_theta(double theta);
     void calc_rotation_theta(double xdir, double ydir);
     void rotate_image();
-    void death_animation();
-    void death_animation2(int32_t death_speed);
     void tighten_image();
 };
 
 
-struct BackGround {
-    Pixel background[SCREEN_HEIGHT][SCREEN_WIDTH];
-    int bwidth, bheight;
+struct TextureRequest {
+    const char *path;
+    bool tight;
+};
+
+
+// Textures by path. Each file is decoded once and everything drawing it shares that copy, tight
+// asks for the one trimmed by tighten_image() which is kept apart from the plain one. Like the
+// pixel buffers the cache is never destroyed. Decoding happens outside the lock, so textures
+// asked for from several threads are decoded side by side. A file that cannot be read is
+// reported when it is asked for and stays cached as an empty texture counted missing.
+class TextureCache {
+    std::mutex mutex;
+    std::map<std::pair<std::string, bool>, std::unique_ptr<Texture>> textures;
+    int32_t decodes = 0, missing = 0;
+    public:
+    const Texture& get(const char *path, bool tight = false);
+    void preload(const std::vector<TextureRequest> &requests, ThreadPool &pool);
+    void report(std::ostream &out);
+};
+
+TextureCache& texture_cache();
+
+// A texture from the pack when it is there, decoded from the PNG otherwise.
+Texture load_texture(const char *path, bool tight = false);
+
 
+// A mob texture rotated in advance to SPRITE_FRAMES turns. All the mobs wearing it share the
+// frames, a spinning mob only moves to another one. The frames are kept palette indexed, the
+// source texture stays as the one giving the size.
+class Sprite {
+    const Texture *source;
+    std::unique_ptr<Palette> palette;
+    std::vector<IndexedTexture> frames;
+    public:
+    Sprite(const Texture &tex, ThreadPool *pool = nullptr);
+    const Texture& get_source() const {return *source;}
+    const IndexedTexture& frame(double angle) const;
+    const Palette& get_palette() const {return *palette;}
+    size_t bytes() const;
+};
+
+
+// A background drawn straight from one small tile every frame. Each tile row is stored with
+// its first pixels repeated after its end, so eight pixels starting anywhere in the row can be
+// read with one load. The tiles move by parallax times the camera position.
+class BackGround {
+    std::vector<uint32_t> rows;
+    int32_t tile_w, tile_h, row_len;
+    double parallax = 0;
+    public:
     BackGround(const char *s);
-    BackGround(const BackGround &c);
-    BackGround(BackGround &&c) = delete;
+    void set_parallax(double factor) {parallax = factor;}
+    void draw(uint32_t *dst, int32_t width, int32_t height, int32_t pitch, double camera_x = 0, double camera_y = 0) const;
+    size_t bytes() const {return rows.size() * sizeof(uint32_t);}
 };
 
 
@@ -92,170 +143,149 @@ struct DeathBackGround {
 
 
 class Score {
-    Texture zero = Texture("textures/0.png");
-    Texture one = Texture("textures/1.png");
-    Texture two = Texture("textures/2.png");
-    Texture three = Texture("textures/3.png");
-    Texture four = Texture("textures/4.png");
-    Texture five = Texture("textures/5.png");
-    Texture six = Texture("textures/6.png");
-    Texture seven = Texture("textures/7.png");
-    Texture eight = Texture("textures/8.png");
-    Texture nine = Texture("textures/9.png");
+    const Texture *digits[10];
     int32_t score = 0;
     int32_t score_len;
     public:
     Score(int32_t score_len);
     void add_score(int32_t score) {this->score += score;}
+    int32_t get_score() const {return score;}
     void draw();
 };
 
 
+// Fields shared by every entity. Entities are stored by value in one array per type and
+// never handled through a base pointer, so nothing here is virtual. The texture belongs to
+// MobCreator and is shared, which keeps every entity a plain record that copies with memcpy.
 struct Object {
+    const Texture *tex = nullptr;
     double hp = 0;
-    int32_t score = 0;
     double speed = 0;
     double damage = 0;
-
+    int32_t score = 0;
     int xpos = 0, ypos = 0;
-    Texture tex;
+    int prev_xpos = 0, prev_ypos = 0;
 
-    virtual double get_hp() const {return hp;}
-    virtual int32_t get_score() const {return score;}
-    virtual double get_speed() const {return speed;}
-    virtual double get_damage() const {return damage;}
-    virtual int get_xpos() const {return xpos;}
-    virtual int get_ypos() const {return ypos;}
-    virtual void act(int xppos, int yppos){}
-    virtual int32_t draw(int32_t mob_idx){return 0;}
-    virtual Object* attack(int xppos, int yppos) {return nullptr;}
-    virtual void deal_damage(double damage) {hp -= damage;}
-    virtual bool is_dead() const {return hp <= 0;}
-    virtual ~Object(){}
+    Object(){}
+    Object(double hp, int32_t score, double speed, double damage, int xpos, int ypos, const Texture &tex):
+            tex(&tex), hp(hp), speed(speed), damage(damage), score(score), xpos(xpos), ypos(ypos), prev_xpos(xpos), prev_ypos(ypos) {}
+
+    double get_hp() const {return hp;}
+    int32_t get_score() const {return score;}
+    double get_speed() const {return speed;}
+    double get_damage() const {return damage;}
+    int get_xpos() const {return xpos;}
+    int get_ypos() const {return ypos;}
+    int get_w2() const {return tex->get_w2();}
+    int get_h2() const {return tex->get_h2();}
+    const Texture& get_tex() const {return *tex;}
+    void deal_damage(double damage) {hp -= damage;}
+    bool is_dead() const {return hp <= 0;}
+    void save_position() {prev_xpos = xpos, prev_ypos = ypos;}
+    int draw_xpos(double alpha) const {return lerp_position(prev_xpos, xpos, alpha);}
+    int draw_ypos(double alpha) const {return lerp_position(prev_ypos, ypos, alpha);}
 };
 
 
-struct ChaserMob: public Object {
-    double hp;
-    int32_t score;
-    double speed;
+// Entities live in one slot map per type. Ids handed out to the broadphase and the spatial
+// queries are positions in those maps with the type in the bits above TYPE_SHIFT, they hold
+// for the frame they were handed out in. An EntityHandle keeps referring to its entity.
+enum EntityType {
+    CHASER_TYPE,
+    BOUNCER_TYPE,
+    SHOOTER_TYPE,
+    MOB_BULLET_TYPE,
+    BUFF_TYPE
+};
 
-    double xresidue = 0, yresidue = 0;
-    int xpos, ypos;
+inline int32_t entity_id(int32_t type, int32_t idx) {return (type << TYPE_SHIFT) | idx;}
+inline int32_t entity_type(int32_t id) {return id >> TYPE_SHIFT;}
+inline int32_t entity_index(int32_t id) {return id & ((1 << TYPE_SHIFT) - 1);}
+
+
+enum TimerKind {
+    SHOOT_TIMER,
+    RAMP_TIMER,
+    SPAWN_TIMER,
+    WAVE_TIMER
+};
 
-    Texture tex;
 
-    int64_t timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+struct EntityHandle {
+    int32_t type = -1;
+    Handle handle;
+};
+
+
+struct ChaserMob final: public Object {
+    double xresidue = 0, yresidue = 0;
+    int64_t timer = frame_now();
     int32_t upd_freq = 10;
     bool isnew = true;
 
-    ChaserMob(double hp, int32_t score, int xpos, int ypos, double speed, int32_t upd_ms, Texture &tex, uint8_t alpha);
+    ChaserMob(double hp, int32_t score, int xpos, int ypos, double speed, int32_t upd_ms, const Texture &tex, uint8_t alpha);
 
-    void deal_damage(double damage);
-    double get_damage() const {return damage;}
-    bool is_dead() const;
-    double get_hp() const;
-    int32_t get_score() const;
-    double get_speed() const;
-    int get_xpos() const;
-    int get_ypos() const;
     void check_new();
     void act_new();
     void act_main(int xppos, int yppos);
-    void act(int xppos, int yppos);
-    int32_t draw(int32_t mob_idx);
+    bool step_due(const FrameTime &t);
+    void act(const FrameTime &t, int xppos, int yppos);
+    void gather(MobBatch &b, int32_t i) const;
+    void scatter(const MobBatch &b, int32_t k);
+    void draw(double alpha);
 };
 
 
-struct BouncerMob: public Object {
-    double hp;
-    int32_t score;
-    double speed = 0;
+struct BouncerMob final: public Object {
+    static constexpr double acc_modifier = 0.2;
 
     double xresidue = 0, yresidue = 0;
-    int xpos, ypos;
     double xdir, ydir;
-    double acc_modifier = 0.2 / RAND_MAX;
-
-    Texture tex;
-
-    int64_t timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    double angle = 0, spin = 0;
+    const Sprite *sprite;
+    const IndexedTexture *frame;
+    Rng rng;
+    int64_t timer = frame_now();
     int32_t upd_freq = 10;
     bool isnew = true;
 
-    BouncerMob(double hp, int32_t score, int xpos, int ypos, double xdir, double ydir, int32_t upd_ms, Texture &tex, uint8_t alpha);
+    BouncerMob(double hp, int32_t score, int xpos, int ypos, double xdir, double ydir, int32_t upd_ms, const Sprite &sprite, uint8_t alpha, const Rng &rng);
 
-    void deal_damage(double damage);
-    double get_damage() const {return damage;}
-    bool is_dead() const;
-    double get_hp() const;
-    int32_t get_score() const;
-    double get_speed() const;
-    int get_xpos() const;
-    int get_ypos() const;
+    void launch(double xdir, double ydir, const Rng &rng);
 
     void check_new();
     void act_new();
     void act_main(int xppos, int yppos);
-    void act(int xppos, int yppos);
-    int32_t draw(int32_t mob_idx);
+    bool step_due(const FrameTime &t);
+    void act(const FrameTime &t, int xppos, int yppos);
+    void gather(MobBatch &b, int32_t i) const;
+    void scatter(const MobBatch &b, int32_t k);
+    void draw(double alpha);
 };
 
 
-struct AngleShooterMob: public Object {
-    double hp = 0;
-    int32_t score;
-    double speed;
-    double bspeed;
+class CommandBuffer;
 
-    double xresidue = 0, yresidue = 0;
-    int xpos, ypos;
 
-    Texture tex;
-    Texture bullet;
-    int64_t timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    int64_t bullet_timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+struct AngleShooterMob final: public Object {
+    double bspeed;
+    double xresidue = 0, yresidue = 0;
+    const Texture *bullet;
+    int64_t timer = frame_now();
     int32_t upd_freq, bullet_ms;
     bool isnew = true, ready_to_shoot = false;
 
-    AngleShooterMob(double hp, int32_t score, int xpos, int ypos, double speed, double bspeed, int32_t upd_ms, int32_t bullet_ms, Texture &tex, Texture &btex, uint8_t alpha);
-
-    void deal_damage(double damage);
-    double get_damage() const {return damage;}
-    bool is_dead() const;
-    double get_hp() const;
-    int32_t get_score() const;
-    double get_speed() const;
-    int get_xpos() const;
-    int get_ypos() const;
+    AngleShooterMob(double hp, int32_t score, int xpos, int ypos, double speed, double bspeed, int32_t upd_ms, int32_t bullet_ms, const Texture &tex, const Texture &btex, uint8_t alpha);
 
     void check_new();
     void act_new();
     void act_main(int xppos, int yppos);
-    void act(int xppos, int yppos);
-    int32_t draw(int32_t mob_idx);
-    Object* attack(int xppos, int yppos);
-};
-
-
-class PlayerBullet: public Object {
-    double speed;
-    double xdir, ydir, sdir;
-    double xresidue = 0, yresidue = 0;
-    double damage;
-    int32_t xpos, ypos;
-    Texture tex;
-    int64_t timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    int32_t upd_freq = 10;
-    double hp = 0.0001;
-
-    public:
-    PlayerBullet(double damage, double speed, double xdir, double ydir, int32_t xpos, int32_t ypos, Texture &tex, int32_t upd_freq);
-    void act(int xppos, int yppos);
-    int32_t draw(int32_t mob_idx);
-    double get_damage() const {return damage;}
-    void deal_damage(double damage) {hp -= damage;}
-    bool is_dead() const {return hp <= 0;}
+    bool step_due(const FrameTime &t);
+    void act(const FrameTime &t, int xppos, int yppos);
+    void gather(MobBatch &b, int32_t i) const;
+    void scatter(const MobBatch &b, int32_t k);
+    void draw(double alpha);
+    void attack(int xppos, int yppos, CommandBuffer &commands);
 };
 
 
@@ -263,116 +293,191 @@ class Player {
     int32_t hp = 1;
     double speed;
     int xspeed = 0, yspeed = 0;
-    double shoot_speed_ms, last_shot_time = 0;
+    double shoot_speed_ms, last_shot_time = -INFINITY;
     int32_t damage;
     int xpos, ypos;
+    int prev_xpos, prev_ypos;
     double xdir = 0, ydir = 1;
     Texture tex;
-    Texture bullet_tex;
-    int64_t timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const Texture *bullet_tex = nullptr;
+    int64_t timer = frame_now();
     int32_t upd_freq = 10;
-    int64_t last_damage_time = -1;
-    std::vector<Texture> nums {
-    Texture("textures/0.png"),
-    Texture("textures/1.png"),
-    Texture("textures/2.png"),
-    Texture("textures/3.png"),
-    Texture("textures/4.png"),
-    Texture("textures/5.png"),
-    Texture("textures/6.png"),
-    Texture("textures/7.png"),
-    Texture("textures/8.png"),
-    Texture("textures/9.png")
-    };
-    Texture texhp = Texture("textures/health.png");
-    Texture texdmg = Texture("textures/speed.png");
+    int64_t last_damage_time = INT64_MIN / 2;
+    const Texture *nums[10] = {};
+    const Texture *texhp = nullptr;
+    const Texture *texdmg = nullptr;
 
     public:
     Player(double speed, double shoot_speed_ms, double damage, double xpos, double ypos, double xdir, double ydir, const char *path, const char *bpath);
     Player(){}
     void set_damage(int32_t damage) {this->damage = damage;}
     void set_speed(double speed) {this->speed = speed;}
+    void set_shoot_speed(double shoot_speed_ms) {this->shoot_speed_ms = shoot_speed_ms;}
     void set_xspeed(int xspeed) {this->xspeed = xspeed;}
     void set_yspeed(int yspeed) {this->yspeed = yspeed;}
     void set_dir(double xdir, double ydir) {this->xdir = xdir - xpos, this->ydir = ydir - ypos;}
-    void set_bullet_tex(Texture &tex) {this->tex = tex;}
-    Texture& get_bullet_tex() {return bullet_tex;}
+    void set_bullet_tex(const Texture &tex) {bullet_tex = &tex;}
+    const Texture& get_bullet_tex() const {return *bullet_tex;}
+    const Texture& get_tex() const {return tex;}
     int get_xpos() const {return xpos;}
     int get_ypos() const {return ypos;}
     int get_xdir() const {return xdir;}
     int get_ydir() const {return ydir;}
     bool is_dead() const {return hp <= 0;}
+    int32_t get_hp() const {return hp;}
     void add_damage(int32_t damage) {this->damage = std::min(damage + this->damage, 999);}
     void add_hp(int32_t hp) {this->hp = std::min(hp + this->hp, 9);}
 
-    void act();
-    void draw();
+    void act(const FrameTime &t);
+    void hit(const FrameTime &t);
+    void draw(double alpha);
     void draw_stats();
-    bool can_shoot();
+    bool can_shoot(const FrameTime &t);
 };
 
 
-class Living_Objects {
-    std::vector<Object*> objects;
-    std::vector<Object*> pbullets;
-    std::vector<Object*> buffs;
-    std::vector<uint32_t> collected_buffs;
-    int num_deleted = 0;
-    
-    void remake_vectors();
+class Buff final: public Object {
+    int32_t buff_type;
+
     public:
-    Living_Objects(){}
-    ~Living_Objects();
-
-    void add(Object *obj);
-    void add_pbullet(Object *obj);
-    void give_buffs(Player &p);
-    
-    int32_t act(int xppos, int yppos);
-    int32_t draw();
+    Buff(int32_t buff_type, int32_t xpos, int32_t ypos, const Texture &tex): Object(0.001, 0, 0, 0, xpos, ypos, tex), buff_type(buff_type) {}
+    void act(int xppos, int yppos);
+    void draw(double alpha);
+    int32_t get_buff_type() const {return buff_type;}
 };
 
 
-class Buff: public Object {
-    double hp = 0.001;
-    int32_t buff_type;
-    
+// Structural changes recorded while the entities are being updated and applied together by
+// Living_Objects::apply_commands(), so nothing is inserted into or erased from an array that
+// is being walked, and an entity spawned during a frame starts moving in the next one.
+class CommandBuffer {
+    std::vector<ChaserMob> chasers;
+    std::vector<BouncerMob> bouncers;
+    std::vector<AngleShooterMob> shooters;
+    std::vector<Buff> buffs;
+    std::vector<ProjectileSpawn> projectiles;
+    std::vector<EntityHandle> despawns;
+    std::vector<int32_t> buff_grants;
 
-    int xpos, ypos;
-    Texture tex;
+    friend class Living_Objects;
+    public:
+    void spawn(ChaserMob &&mob) {chasers.push_back(std::move(mob));}
+    void spawn(BouncerMob &&mob) {bouncers.push_back(std::move(mob));}
+    void spawn(AngleShooterMob &&mob) {shooters.push_back(std::move(mob));}
+    void spawn(Buff &&buff) {buffs.push_back(std::move(buff));}
+    void spawn_projectile(int32_t owner, double damage, double speed, double xdir, double ydir, int32_t xpos, int32_t ypos, const Texture &tex) {
+        projectiles.push_back({owner, damage, speed, xdir, ydir, xpos, ypos, &tex});
+    }
+    void reserve(int32_t nchasers, int32_t nbouncers, int32_t nshooters);
+    void despawn(const EntityHandle &h) {despawns.push_back(h);}
+    void grant_buff(int32_t buff) {buff_grants.push_back(buff);}
+    void append(CommandBuffer &other);
+    void clear();
+};
 
-    int64_t timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    int32_t upd_freq = 10;
+
+class Living_Objects {
+    SlotMap<ChaserMob> chasers {MOB_POOL_CAPACITY};
+    SlotMap<BouncerMob> bouncers {MOB_POOL_CAPACITY};
+    SlotMap<AngleShooterMob> shooters {MOB_POOL_CAPACITY};
+    SlotMap<Buff> buffs {BUFF_POOL_CAPACITY};
+    ProjectileSystem projectiles;
+    CommandBuffer commands;
+    std::vector<CommandBuffer> chunk_commands;
+    std::vector<MobBatch> chunk_batches;
+    TimerWheel timers {uint64_t(frame_clock().get().frame)};
+    int64_t kills = 0;
+    ThreadPool *pool = nullptr;
+    SpatialGrid index;
+    SpatialGrid grid;
+    QuadTree tree;
+    SweepAndPrune sweep;
+    std::vector<int32_t> candidates;
+    std::vector<std::pair<int32_t, int32_t>> contacts;
+    std::vector<uint8_t> touching;
+    std::vector<uint8_t> hit_mobs;
+
+    void remove_dead();
+    ThreadPool& workers() {return pool != nullptr ? *pool : thread_pool();}
+    template <class T, class Kernel>
+    void act_chunks(const FrameTime &t, SlotMap<T> &entities, Kernel kernel);
+    void act_shooters(const FrameTime &t, int xppos, int yppos);
+    void build_index();
+    template <class Broadphase>
+    void find_contacts(Broadphase &broadphase, Player &p);
+    void find_contacts_sweep(Player &p);
+    template <class T>
+    bool mob_overlaps(int32_t other, const T &look, int x, int y, const Player &p) const;
     public:
-    Buff(int32_t buff_type, int32_t xpos, int32_t ypos, Texture &tex): buff_type(buff_type), xpos(xpos), ypos(ypos), tex(tex) {}
-    void act(int xppos, int yppos);
-    int32_t draw(int32_t mob_idx);
-    int32_t get_score() const {return buff_type;}
-    bool is_dead() const {return hp < 0;};
+    Living_Objects(){}
+    void set_thread_pool(ThreadPool &p) {pool = &p;}
+
+    CommandBuffer& get_commands() {return commands;}
+    void apply_commands(Player &p);
+    int32_t size() const;
+    int32_t count_of(int32_t type) const;
+    int64_t get_kills() const {return kills;}
+    void report_pools(std::ostream &out) const;
+
+    int32_t act(const FrameTime &t, int xppos, int yppos);
+    int32_t collide(const FrameTime &t, Player &p);
+    void draw(double alpha);
+
+    Object* get(int32_t id);
+    EntityHandle handle(int32_t id) const;
+    Object* get(const EntityHandle &h);
+    void position_of(int32_t id, int &x, int &y) const;
+    void nearest(int x, int y, int k, std::vector<int32_t> &out) const {index.nearest(x, y, k, out);}
+    void within_radius(int x, int y, double radius, std::vector<int32_t> &out) const {index.within_radius(x, y, radius, out);}
+    int32_t raycast(int x, int y, double xdir, double ydir, double max_dist) const {return index.raycast(x, y, xdir, ydir, max_dist);}
+};
+
+
+// Mobs built in full for each texture and tier, a tier being the level roll rounded down to
+// 1 / TIERS_PER_LEVEL. They are made the first time they are asked for and spawning copies one.
+template <class T>
+class Prototypes {
+    std::vector<std::vector<T>> tiers;
+    public:
+    template <class Make>
+    const T& get(int32_t tex_id, int32_t tier, Make make) {
+        if (int32_t(tiers.size()) <= tex_id) {
+            tiers.resize(tex_id + 1);
+        }
+        std::vector<T> &row = tiers[tex_id];
+        while (int32_t(row.size()) <= tier) {
+            row.push_back(make(double(row.size()) / TIERS_PER_LEVEL));
+        }
+        return row[tier];
+    }
 };
 
 
 class MobCreator {
-    std::vector<Texture> bouncer_enemies {
-        Texture("textures/3_green_med.png"),
-        Texture("textures/3_salad_med.png"),
-        Texture("textures/4_yellow_thin.png"),
-        Texture("textures/inner_5_0xe97451_50.png"),
-        Texture("textures/inner_6_0xfafa33_75.png")};
-    std::vector<Texture> chaser_enemies {
-        Texture("textures/circle_0xa36c_175_43.png"),
-        Texture("textures/circle_green.png"),
-        Texture("textures/circle_purple.png")
+    std::vector<const Texture*> bouncer_enemies {
+        &texture_cache().get("textures/3_green_med.png"),
+        &texture_cache().get("textures/3_salad_med.png"),
+        &texture_cache().get("textures/4_yellow_thin.png"),
+        &texture_cache().get("textures/inner_5_0xe97451_50.png"),
+        &texture_cache().get("textures/inner_6_0xfafa33_75.png")};
+    std::vector<const Texture*> chaser_enemies {
+        &texture_cache().get("textures/circle_0xa36c_175_43.png"),
+        &texture_cache().get("textures/circle_green.png"),
+        &texture_cache().get("textures/circle_purple.png")
     };
-    std::vector<Texture> shooters {
-        Texture("textures/joe.png")
+    std::vector<const Texture*> shooters {
+        &texture_cache().get("textures/joe.png")
     };
-    std::vector<Texture> shooter_bullets {
-        Texture("textures/joebullet.png")
+    std::vector<const Texture*> shooter_bullets {
+        &texture_cache().get("textures/joebullet.png")
     };
-    std::vector<Texture> buffs {
-        Texture("textures/bonus.png"),
+    std::vector<const Texture*> buffs {
+        &texture_cache().get("textures/bonus.png"),
     };
+    std::vector<Sprite> bouncer_sprites;
+    Prototypes<ChaserMob> chaser_prototypes;
+    Prototypes<BouncerMob> bouncer_prototypes;
+    Prototypes<AngleShooterMob> shooter_prototypes;
     std::vector<int32_t> buff_codes {
         HP_BUFF_CODE,
         DAMAGE_BUFF_CODE
@@ -386,15 +491,28 @@ class MobCreator {
     double create_chance = 0.2;
     double aspect_res_x = 1. / 2. / (1. + double(SCREEN_WIDTH) / SCREEN_HEIGHT);
     double aspect_res_y = 1. / 2. / (1. + double(SCREEN_HEIGHT) / SCREEN_WIDTH);
-    int64_t timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    int64_t mob_timer = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    TimerWheel timers {uint64_t(frame_clock().get().frame)};
+    Rng rng = rng_stream(SPAWN_STREAM);
+    bool spawn_due = false;
+    int32_t burst = 1;
+    WaveTable table;
+    std::vector<int32_t> wave_rounds;
+
+    void edge_point(double side, double along, const Texture &tex, int32_t &xpos, int32_t &ypos) const;
+    void place(const Placement &p, const Texture &tex, int32_t &xpos, int32_t &ypos);
     public:
-    MobCreator(double hp_rate, double speed_rate, double score_rate, int64_t upd_ms, int64_t mob_create_ms):
-            hp_rate(hp_rate), speed_rate(speed_rate), score_rate(score_rate), upd_ms(upd_ms), mob_create_ms(mob_create_ms) {}
-    Object* create_buff();
-    Object* create_bouncer();
-    Object* create_chaser();
-    Object* create_shooter();
-    Object* create_random_mob();
-    Object* act(int32_t nmobs);
+    MobCreator(double hp_rate, double speed_rate, double score_rate, int64_t upd_ms, int64_t mob_create_ms, ThreadPool *pool = nullptr);
+    bool load_waves(const char *path, std::ostream &err);
+    Buff create_buff();
+    BouncerMob create_bouncer(double level, const Placement &p);
+    ChaserMob create_chaser(double level, const Placement &p);
+    AngleShooterMob create_shooter(double level, const Placement &p);
+    BouncerMob create_bouncer() {return create_bouncer(multiplier, Placement());}
+    ChaserMob create_chaser() {return create_chaser(multiplier, Placement());}
+    AngleShooterMob create_shooter() {return create_shooter(multiplier, Placement());}
+    void create_random_mob(Living_Objects &objects);
+    void spawn_wave(const Wave &w, double level, Living_Objects &objects);
+    void act(const FrameTime &t, Living_Objects &objects);
+    // for the load ramp, every spawn roll comes up and brings burst mobs
+    void set_load(int32_t burst) {this->burst = burst, create_chance = 1;}
 };
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "Parallel.h"
+#include <cstdlib>
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int32_t nworkers) {
+    for (int i = 0; i < nworkers; ++i) {
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &t: workers) {
+        t.join();
+    }
+}
+
+
+void ThreadPool::work(int32_t njobs) {
+    int32_t done_here = 0;
+    for (int32_t i = next_job++; i < njobs; i = next_job++) {
+        (*job)(i);
+        done_here++;
+    }
+    std::lock_guard<std::mutex> lock(m);
+    finished += done_here;
+    done.notify_all();
+}
+
+
+void ThreadPool::worker_loop() {
+    uint64_t seen = 0;
+    for (;;) {
+        int32_t n;
+        {
+            std::unique_lock<std::mutex> lock(m);
+            wake.wait(lock, [&] {return stop || generation != seen;});
+            if (stop) {
+                return;
+            }
+            seen = generation;
+            n = njobs;
+            active++;
+        }
+        work(n);
+        std::lock_guard<std::mutex> lock(m);
+        active--;
+        done.notify_all();
+    }
+}
+
+
+void ThreadPool::run(int32_t njobs, const std::function<void(int32_t)> &fn) {
+    if (njobs <= 0) {
+        return;
+    }
+    if (workers.empty() || njobs == 1) {
+        for (int32_t i = 0; i < njobs; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    {
+        // a worker still leaving the previous run would otherwise pick up jobs of this one
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [&] {return active == 0;});
+        job = &fn;
+        this->njobs = njobs;
+        next_job = 0;
+        finished = 0;
+        generation++;
+    }
+    wake.notify_all();
+    work(njobs);
+    std::unique_lock<std::mutex> lock(m);
+    done.wait(lock, [&] {return finished == njobs && active == 0;});
+    job = nullptr;
+}
+
+
+void ThreadPool::parallel_for(int32_t n, int32_t min_chunk, const std::function<void(int32_t, int32_t, int32_t)> &fn) {
+    int32_t nchunks = std::max(std::min(size(), (n + min_chunk - 1) / std::max(min_chunk, 1)), 1);
+    int32_t chunk = (n + nchunks - 1) / nchunks;
+    run(nchunks, [&fn, n, chunk](int32_t c) {
+        int32_t begin = c * chunk, end = std::min(n, begin + chunk);
+        if (begin < end) {
+            fn(begin, end, c);
+        }
+    });
+}
+
+
+ThreadPool& thread_pool() {
+    static ThreadPool pool([] {
+        const char *env = getenv("GW_THREADS");
+        int32_t n = env != nullptr ? atoi(env) : int32_t(std::thread::hardware_concurrency());
+        return std::max(n, 1) - 1;
+    }());
+    return pool;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+
+// Fixed set of worker threads. The calling thread takes jobs as well, so a pool
+// with no workers simply runs everything inline.
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable wake, done;
+    const std::function<void(int32_t)> *job = nullptr;
+    int32_t njobs = 0;
+    std::atomic<int32_t> next_job{0};
+    int32_t finished = 0;
+    int32_t active = 0;
+    uint64_t generation = 0;
+    bool stop = false;
+
+    void work(int32_t njobs);
+    void worker_loop();
+    public:
+    ThreadPool(int32_t nworkers);
+    ThreadPool(const ThreadPool &c) = delete;
+    ~ThreadPool();
+
+    int32_t size() const {return workers.size() + 1;}
+    void run(int32_t njobs, const std::function<void(int32_t)> &fn);
+    void parallel_for(int32_t n, int32_t min_chunk, const std::function<void(int32_t, int32_t, int32_t)> &fn);
+};
+
+
+// Shared pool sized to the machine, GW_THREADS overrides the thread count.
+ThreadPool& thread_pool();
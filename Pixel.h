@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+
+struct Pixel {
+    uint8_t b = 0;
+    uint8_t g = 0;
+    uint8_t r = 0;
+    uint8_t a = 0;
+
+    Pixel(){}
+    Pixel(uint8_t r, uint8_t g, uint8_t b, uint8_t a): r(r), g(g), b(b), a(a) {}
+    Pixel(uint32_t color);
+    Pixel swap_colors();
+    uint32_t pixel() const;
+    uint32_t alpha_mix(Pixel color) const;
+    bool is_color() const;
+    void set_black(uint8_t alpha);
+};
@@ -0,0 +1,230 @@
+#include "Projectiles.h"
+#include "Objects.h"
+#include "Engine.h"
+#include <cmath>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+ProjectileSystem::ProjectileSystem() {
+    xs.resize(PROJECTILE_CAPACITY);
+    ys.resize(PROJECTILE_CAPACITY);
+    prev_xs.resize(PROJECTILE_CAPACITY);
+    prev_ys.resize(PROJECTILE_CAPACITY);
+    xsteps.resize(PROJECTILE_CAPACITY);
+    ysteps.resize(PROJECTILE_CAPACITY);
+    xresidues.resize(PROJECTILE_CAPACITY);
+    yresidues.resize(PROJECTILE_CAPACITY);
+    w2s.resize(PROJECTILE_CAPACITY);
+    h2s.resize(PROJECTILE_CAPACITY);
+    damages.resize(PROJECTILE_CAPACITY);
+    owners.resize(PROJECTILE_CAPACITY);
+    alive.resize(PROJECTILE_CAPACITY);
+    frames_of.resize(PROJECTILE_CAPACITY);
+}
+
+
+ProjectileSystem::~ProjectileSystem() {}
+
+
+size_t ProjectileSystem::bytes_per_projectile() {
+    return 4 * sizeof(int32_t) + 4 * sizeof(double) + 2 * sizeof(int32_t) + sizeof(double) + 2 * sizeof(uint8_t) + sizeof(int32_t);
+}
+
+
+// first frame of the sprite, the frames of a texture are rotated the first time it is fired
+int32_t ProjectileSystem::sprite_of(const Texture *tex) {
+    for (int32_t s = 0; s < int32_t(sprite_sources.size()); ++s) {
+        if (sprite_sources[s] == tex) {
+            return s * PROJECTILE_FRAMES;
+        }
+    }
+    sprite_sources.push_back(tex);
+    for (int32_t k = 0; k < PROJECTILE_FRAMES; ++k) {
+        double angle = 2 * M_PI * k / PROJECTILE_FRAMES;
+        frames.push_back(*tex);
+        frames.back().calc_rotation_theta(-std::sin(angle), std::cos(angle));
+        frames.back().rotate_image();
+    }
+    return (sprite_sources.size() - 1) * PROJECTILE_FRAMES;
+}
+
+
+void ProjectileSystem::spawn(const ProjectileSpawn &s) {
+    double sdir = std::sqrt(s.xdir * s.xdir + s.ydir * s.ydir);
+    if (sdir == 0) {
+        return;
+    }
+    if (count == PROJECTILE_CAPACITY) {
+        ++refused;
+        return;
+    }
+    double theta = std::atan2(-s.xdir, s.ydir);
+    if (theta < 0) {
+        theta += 2 * M_PI;
+    }
+    int32_t frame = sprite_of(s.tex) + int32_t(std::lround(theta / (2 * M_PI) * PROJECTILE_FRAMES)) % PROJECTILE_FRAMES;
+    int32_t i = count++;
+    xs[i] = prev_xs[i] = s.xpos;
+    ys[i] = prev_ys[i] = s.ypos;
+    xsteps[i] = s.xdir / sdir * s.speed;
+    ysteps[i] = s.ydir / sdir * s.speed;
+    xresidues[i] = yresidues[i] = 0;
+    w2s[i] = frames[frame].get_w2();
+    h2s[i] = frames[frame].get_h2();
+    damages[i] = s.damage;
+    owners[i] = s.owner;
+    alive[i] = 1;
+    frames_of[i] = frame;
+    high_water = std::max(high_water, count);
+}
+
+
+void ProjectileSystem::act(const FrameTime &t) {
+    if (t.now - timer >= upd_freq) {
+        std::copy(xs.begin(), xs.begin() + count, prev_xs.begin());
+        std::copy(ys.begin(), ys.begin() + count, prev_ys.begin());
+        integrate();
+        timer = t.now;
+    }
+}
+
+
+// Moves a shot by its whole pixels and keeps the fraction for the next tick,
+// the shot is done once it touches the edge of the screen.
+static inline void step(int32_t &x, double &residue, double step, int32_t half, int32_t limit, uint8_t &alive) {
+    residue += step;
+    int32_t whole = int32_t(residue);
+    residue -= whole;
+    x += whole;
+    if (x < half || x > limit - 1 - half) {
+        alive = 0;
+    }
+}
+
+
+void ProjectileSystem::integrate_scalar(int32_t begin, int32_t end) {
+    for (int32_t i = begin; i < end; ++i) {
+        step(xs[i], xresidues[i], xsteps[i], w2s[i], SCREEN_WIDTH, alive[i]);
+        step(ys[i], yresidues[i], ysteps[i], h2s[i], SCREEN_HEIGHT, alive[i]);
+    }
+}
+
+
+void ProjectileSystem::integrate_scalar() {
+    integrate_scalar(0, count);
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+// Four shots per iteration, the same arithmetic as step() so both paths move shots identically.
+__attribute__((target("avx2")))
+void ProjectileSystem::integrate_avx2(int32_t begin, int32_t end) {
+    const __m128i xlimit = _mm_set1_epi32(SCREEN_WIDTH - 1), ylimit = _mm_set1_epi32(SCREEN_HEIGHT - 1);
+    int32_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d rx = _mm256_add_pd(_mm256_loadu_pd(&xresidues[i]), _mm256_loadu_pd(&xsteps[i]));
+        __m256d ry = _mm256_add_pd(_mm256_loadu_pd(&yresidues[i]), _mm256_loadu_pd(&ysteps[i]));
+        __m256d wx = _mm256_round_pd(rx, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256d wy = _mm256_round_pd(ry, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        _mm256_storeu_pd(&xresidues[i], _mm256_sub_pd(rx, wx));
+        _mm256_storeu_pd(&yresidues[i], _mm256_sub_pd(ry, wy));
+        __m128i x = _mm_add_epi32(_mm_loadu_si128((const __m128i*)&xs[i]), _mm256_cvttpd_epi32(wx));
+        __m128i y = _mm_add_epi32(_mm_loadu_si128((const __m128i*)&ys[i]), _mm256_cvttpd_epi32(wy));
+        _mm_storeu_si128((__m128i*)&xs[i], x);
+        _mm_storeu_si128((__m128i*)&ys[i], y);
+        __m128i w2 = _mm_loadu_si128((const __m128i*)&w2s[i]);
+        __m128i h2 = _mm_loadu_si128((const __m128i*)&h2s[i]);
+        __m128i out = _mm_or_si128(_mm_cmplt_epi32(x, w2), _mm_cmpgt_epi32(x, _mm_sub_epi32(xlimit, w2)));
+        out = _mm_or_si128(out, _mm_or_si128(_mm_cmplt_epi32(y, h2), _mm_cmpgt_epi32(y, _mm_sub_epi32(ylimit, h2))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(out));
+        for (int32_t lane = 0; mask != 0; ++lane, mask >>= 1) {
+            if (mask & 1) {
+                alive[i + lane] = 0;
+            }
+        }
+    }
+    integrate_scalar(i, end);
+}
+
+
+void ProjectileSystem::integrate() {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        integrate_avx2(0, count);
+    } else {
+        integrate_scalar();
+    }
+}
+#else
+void ProjectileSystem::integrate_avx2(int32_t begin, int32_t end) {
+    integrate_scalar(begin, end);
+}
+
+
+void ProjectileSystem::integrate() {
+    integrate_scalar();
+}
+#endif
+
+
+// drops the flagged shots, the rest keep their order
+void ProjectileSystem::compact() {
+    int32_t n = 0;
+    for (int32_t i = 0; i < count; ++i) {
+        if (!alive[i]) {
+            continue;
+        }
+        if (n != i) {
+            xs[n] = xs[i];
+            ys[n] = ys[i];
+            prev_xs[n] = prev_xs[i];
+            prev_ys[n] = prev_ys[i];
+            xsteps[n] = xsteps[i];
+            ysteps[n] = ysteps[i];
+            xresidues[n] = xresidues[i];
+            yresidues[n] = yresidues[i];
+            w2s[n] = w2s[i];
+            h2s[n] = h2s[i];
+            damages[n] = damages[i];
+            owners[n] = owners[i];
+            alive[n] = 1;
+            frames_of[n] = frames_of[i];
+        }
+        ++n;
+    }
+    count = n;
+}
+
+
+// live shots fired by owner
+int32_t ProjectileSystem::count_owned(int32_t owner) const {
+    int32_t n = 0;
+    for (int32_t i = 0; i < count; ++i) {
+        n += alive[i] && owners[i] == owner;
+    }
+    return n;
+}
+
+
+void ProjectileSystem::draw(int32_t owner, double alpha) const {
+    for (int32_t k = 0; k < count; ++k) {
+        if (!alive[k] || owners[k] != owner) {
+            continue;
+        }
+        const Texture &tex = frames[frames_of[k]];
+        int x = lerp_position(prev_xs[k], xs[k], alpha), y = lerp_position(prev_ys[k], ys[k], alpha);
+        int i0 = std::max(y - tex.get_h2(), 0), i1 = std::min(y + tex.get_h2(), SCREEN_HEIGHT);
+        int j0 = std::max(x - tex.get_w2(), 0), j1 = std::min(x + tex.get_w2(), SCREEN_WIDTH);
+        for (int i = i0; i < i1; ++i) {
+            int row = (i - y + tex.get_h2()) * tex.get_w() - x + tex.get_w2();
+            for (int j = j0; j < j1; ++j) {
+                if (tex[row + j].a != 0) {
+                    buffer[i][j] = tex[row + j].alpha_mix(buffer[i][j]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "FrameClock.h"
+
+#define PROJECTILE_CAPACITY 65536
+#define PROJECTILE_FRAMES 64
+
+class Texture;
+
+
+enum ProjectileOwner {
+    PLAYER_OWNER,
+    MOB_OWNER
+};
+
+
+struct ProjectileSpawn {
+    int32_t owner;
+    double damage, speed;
+    double xdir, ydir;
+    int32_t xpos, ypos;
+    const Texture *tex;
+};
+
+
+// Every shot in flight, player and mob ones alike, stored as one array per field. All of them
+// move on the same tick with a vectorized kernel, shots that leave the screen or hit something
+// are only flagged and get compacted away at the sync point of the frame, so indices handed
+// out in a frame stay valid until its end. Sprites are drawn from frames rotated in advance.
+class ProjectileSystem {
+    std::vector<int32_t> xs, ys;
+    std::vector<int32_t> prev_xs, prev_ys;
+    std::vector<double> xsteps, ysteps;
+    std::vector<double> xresidues, yresidues;
+    std::vector<int32_t> w2s, h2s;
+    std::vector<double> damages;
+    std::vector<uint8_t> owners;
+    std::vector<uint8_t> alive;
+    std::vector<int32_t> frames_of;
+    int32_t count = 0;
+    int32_t high_water = 0;
+    int64_t refused = 0;
+
+    std::vector<const Texture*> sprite_sources;
+    std::vector<Texture> frames;
+
+    int64_t timer = frame_now();
+    int32_t upd_freq = 10;
+
+    int32_t sprite_of(const Texture *tex);
+    void integrate_avx2(int32_t begin, int32_t end);
+    void integrate_scalar(int32_t begin, int32_t end);
+    public:
+    ProjectileSystem();
+    ~ProjectileSystem();
+
+    void spawn(const ProjectileSpawn &s);
+    void act(const FrameTime &t);
+    void integrate();
+    void integrate_scalar();
+    void compact();
+    void draw(int32_t owner, double alpha) const;
+    void kill(int32_t i) {alive[i] = 0;}
+    void clear() {count = 0;}
+
+    int32_t size() const {return count;}
+    int32_t count_owned(int32_t owner) const;
+    bool is_alive(int32_t i) const {return alive[i];}
+    int32_t get_owner(int32_t i) const {return owners[i];}
+    int32_t get_xpos(int32_t i) const {return xs[i];}
+    int32_t get_ypos(int32_t i) const {return ys[i];}
+    int32_t get_w2(int32_t i) const {return w2s[i];}
+    int32_t get_h2(int32_t i) const {return h2s[i];}
+    double get_damage(int32_t i) const {return damages[i];}
+    const Texture& get_tex(int32_t i) const {return frames[frames_of[i]];}
+    int32_t get_capacity() const {return PROJECTILE_CAPACITY;}
+    int32_t get_high_water() const {return high_water;}
+    int64_t get_refused() const {return refused;}
+    static size_t bytes_per_projectile();
+
+    template <class F>
+    void for_each(int32_t owner, F fn) const {
+        for (int32_t i = 0; i < count; ++i) {
+            if (alive[i] && owners[i] == owner) {
+                fn(i);
+            }
+        }
+    }
+};
@@ -0,0 +1,30 @@
+#include "Random.h"
+#include <random>
+#include <cstdlib>
+
+
+static uint64_t seed_from_env() {
+    if (const char *env = getenv("GW_SEED")) {
+        return strtoull(env, nullptr, 10);
+    }
+    std::random_device rd;
+    return (uint64_t(rd()) << 32) | rd();
+}
+
+
+uint64_t rng_seed() {
+    static const uint64_t seed = seed_from_env();
+    return seed;
+}
+
+
+Rng rng_stream(uint64_t stream) {
+    return Rng(rng_seed(), stream);
+}
+
+
+Rng Rng::split() {
+    Rng r;
+    r.key = next();
+    return r;
+}
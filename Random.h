@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#define RNG_GAMMA 0x9E3779B97F4A7C15ull
+
+
+enum RngStream {
+    SPAWN_STREAM = 1
+};
+
+
+inline uint64_t rng_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+// Counter based generator: the nth number of a stream is the SplitMix64 mix of key + n * RNG_GAMMA,
+// a pure function of the key and n. Streams with different keys are independent, any number can
+// be generated without the ones before it and copying an Rng forks the stream. Sixteen bytes,
+// small enough for an entity to carry its own.
+class Rng {
+    uint64_t key = 0;
+    uint64_t counter = 0;
+    public:
+    Rng(){}
+    Rng(uint64_t seed, uint64_t stream): key(rng_mix(seed ^ rng_mix(stream * RNG_GAMMA))) {}
+
+    uint64_t at(uint64_t n) const {return rng_mix(key + (n + 1) * RNG_GAMMA);}
+    uint64_t next() {return at(counter++);}
+    // [0, 1)
+    double uniform() {return (next() >> 11) * 0x1.0p-53;}
+    // new stream keyed by the next number of this one
+    Rng split();
+};
+
+
+// Seed of every stream in the game, GW_SEED or drawn from std::random_device on first use.
+uint64_t rng_seed();
+Rng rng_stream(uint64_t stream);
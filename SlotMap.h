@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <algorithm>
+
+
+// Refers to one entity for as long as it lives. The generation of a slot changes every time
+// its entity is erased, so a handle kept past the end of its entity no longer resolves.
+struct Handle {
+    uint32_t slot = 0;
+    uint32_t generation = 0;
+
+    bool operator==(const Handle &o) const {return slot == o.slot && generation == o.generation;}
+    bool operator!=(const Handle &o) const {return !(*this == o);}
+};
+
+
+// Live entities are packed at the front of one array allocated once up front, so iteration
+// never meets a dead slot. Erasing moves the last entity into the hole, the slot table maps
+// handles to the current positions and chains the free slots, insert and erase are O(1).
+// A full map refuses the insert instead of growing.
+template <class T>
+class SlotMap {
+    struct Slot {
+        int32_t index;
+        uint32_t generation = 1;
+    };
+
+    T *items;
+    std::vector<uint32_t> item_slots;
+    std::vector<Slot> slots;
+    int32_t free_head = 0;
+    int32_t capacity;
+    int32_t count = 0;
+    int32_t high_water = 0;
+    int64_t refused = 0;
+
+    public:
+    explicit SlotMap(int32_t capacity): capacity(capacity) {
+        items = static_cast<T*>(::operator new(sizeof(T) * capacity));
+        item_slots.assign(capacity, 0);
+        slots.resize(capacity);
+        for (int32_t i = 0; i < capacity; ++i) {
+            slots[i].index = i + 1;
+        }
+    }
+    SlotMap(const SlotMap &c) = delete;
+    SlotMap& operator=(const SlotMap &c) = delete;
+    ~SlotMap() {
+        clear();
+        ::operator delete(items);
+    }
+
+    // handle of the new entity, a handle that never resolves when the map is full
+    template <class... Args>
+    Handle insert(Args&&... args) {
+        if (count == capacity) {
+            ++refused;
+            return Handle();
+        }
+        int32_t s = free_head;
+        free_head = slots[s].index;
+        new (items + count) T(std::forward<Args>(args)...);
+        slots[s].index = count;
+        item_slots[count] = s;
+        high_water = std::max(high_water, ++count);
+        return Handle{uint32_t(s), slots[s].generation};
+    }
+
+    void erase_at(int32_t index) {
+        uint32_t s = item_slots[index];
+        int32_t last = count - 1;
+        if (index != last) {
+            items[index] = std::move(items[last]);
+            item_slots[index] = item_slots[last];
+            slots[item_slots[index]].index = index;
+        }
+        items[last].~T();
+        --count;
+        if (++slots[s].generation == 0) {
+            slots[s].generation = 1;
+        }
+        slots[s].index = free_head;
+        free_head = s;
+    }
+
+    void erase(Handle h) {
+        if (contains(h)) {
+            erase_at(slots[h.slot].index);
+        }
+    }
+
+    void clear() {
+        while (count > 0) {
+            erase_at(count - 1);
+        }
+    }
+
+    bool contains(Handle h) const {return h.slot < uint32_t(capacity) && h.generation != 0 && slots[h.slot].generation == h.generation;}
+    T* get(Handle h) {return contains(h) ? items + slots[h.slot].index : nullptr;}
+    Handle handle_of(int32_t index) const {return Handle{item_slots[index], slots[item_slots[index]].generation};}
+
+    T& operator[](int32_t index) {return items[index];}
+    const T& operator[](int32_t index) const {return items[index];}
+    T* begin() {return items;}
+    T* end() {return items + count;}
+    int32_t size() const {return count;}
+    int32_t get_capacity() const {return capacity;}
+    int32_t get_high_water() const {return high_water;}
+    int64_t get_refused() const {return refused;}
+
+    template <class F>
+    void for_each(F fn) {
+        for (int32_t i = 0; i < count; ++i) {
+            fn(i, items[i]);
+        }
+    }
+};
@@ -0,0 +1,541 @@
+#include "Spatial.h"
+#include "Engine.h"
+#include "Parallel.h"
+#include <cmath>
+#include <queue>
+#include <limits>
+#include <algorithm>
+
+
+static bool slab(double x0, double y0, double x1, double y1, double x, double y, double dx, double dy, double &tmin, double &tmax) {
+    tmin = 0;
+    tmax = std::numeric_limits<double>::infinity();
+    if (dx == 0) {
+        if (x < x0 || x >= x1) {
+            return false;
+        }
+    } else {
+        double t0 = (x0 - x) / dx, t1 = (x1 - x) / dx;
+        tmin = std::max(tmin, std::min(t0, t1));
+        tmax = std::min(tmax, std::max(t0, t1));
+    }
+    if (dy == 0) {
+        if (y < y0 || y >= y1) {
+            return false;
+        }
+    } else {
+        double t0 = (y0 - y) / dy, t1 = (y1 - y) / dy;
+        tmin = std::max(tmin, std::min(t0, t1));
+        tmax = std::min(tmax, std::max(t0, t1));
+    }
+    return tmin <= tmax;
+}
+
+
+// AABB
+double AABB::dist2(double x, double y) const {
+    double ddx = std::max(std::max(x0 - x, 0.), x - x1);
+    double ddy = std::max(std::max(y0 - y, 0.), y - y1);
+    return ddx * ddx + ddy * ddy;
+}
+
+
+bool AABB::ray_hit(double x, double y, double dx, double dy, double &t) const {
+    double tmax;
+    return slab(x0, y0, x1, y1, x, y, dx, dy, t, tmax);
+}
+
+
+// SpatialGrid
+SpatialGrid::SpatialGrid(int32_t cell_size): cell_size(cell_size) {
+    // spawning mobs live up to a sprite size outside the screen
+    origin = -2 * cell_size;
+    cols = (SCREEN_WIDTH + cell_size - 1) / cell_size + 4;
+    rows = (SCREEN_HEIGHT + cell_size - 1) / cell_size + 4;
+    cell_start.assign(cols * rows + 1, 0);
+}
+
+
+int32_t SpatialGrid::col_of(int32_t x) const {
+    return std::min(std::max(x - origin, 0) / cell_size, cols - 1);
+}
+
+
+int32_t SpatialGrid::row_of(int32_t y) const {
+    return std::min(std::max(y - origin, 0) / cell_size, rows - 1);
+}
+
+
+uint32_t SpatialGrid::next_stamp() const {
+    if (stamps.size() < entries.size()) {
+        stamps.resize(entries.size(), 0);
+    }
+    if (++stamp == 0) {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+    return stamp;
+}
+
+
+void SpatialGrid::clear() {
+    entries.clear();
+    cell_items.clear();
+    std::fill(cell_start.begin(), cell_start.end(), 0);
+    built = false;
+}
+
+
+void SpatialGrid::insert(int32_t id, int32_t x, int32_t y, int32_t w2, int32_t h2) {
+    entries.push_back({id, x, y, AABB::centered(x, y, w2, h2)});
+    built = false;
+}
+
+
+void SpatialGrid::build() {
+    std::fill(cell_start.begin(), cell_start.end(), 0);
+    for (const Entry &e: entries) {
+        for (int32_t r = row_of(e.box.y0); r <= row_of(e.box.y1 - 1); ++r) {
+            for (int32_t c = col_of(e.box.x0); c <= col_of(e.box.x1 - 1); ++c) {
+                cell_start[r * cols + c + 1]++;
+            }
+        }
+    }
+    for (int i = 1; i < int(cell_start.size()); ++i) {
+        cell_start[i] += cell_start[i - 1];
+    }
+    cell_items.resize(cell_start.back());
+    cell_fill.assign(cell_start.begin(), cell_start.end() - 1);
+    for (int i = 0; i < int(entries.size()); ++i) {
+        const AABB &b = entries[i].box;
+        for (int32_t r = row_of(b.y0); r <= row_of(b.y1 - 1); ++r) {
+            for (int32_t c = col_of(b.x0); c <= col_of(b.x1 - 1); ++c) {
+                cell_items[cell_fill[r * cols + c]++] = i;
+            }
+        }
+    }
+    built = true;
+}
+
+
+void SpatialGrid::nearest(int32_t x, int32_t y, int32_t k, std::vector<int32_t> &out) const {
+    out.clear();
+    if (!built || k <= 0 || entries.empty()) {
+        return;
+    }
+    uint32_t s = next_stamp();
+    std::priority_queue<std::pair<double, int32_t>> best;
+    int32_t cx = col_of(x), cy = row_of(y);
+    int32_t max_ring = std::max(cols, rows);
+    for (int32_t ring = 0; ring <= max_ring; ++ring) {
+        for (int32_t r = cy - ring; r <= cy + ring; ++r) {
+            if (r < 0 || r >= rows) {
+                continue;
+            }
+            bool edge_row = r == cy - ring || r == cy + ring;
+            for (int32_t c = cx - ring; c <= cx + ring; c += (edge_row ? 1 : 2 * ring)) {
+                if (c >= 0 && c < cols) {
+                    int32_t cell = r * cols + c;
+                    for (int32_t it = cell_start[cell]; it < cell_start[cell + 1]; ++it) {
+                        int32_t i = cell_items[it];
+                        if (stamps[i] == s) {
+                            continue;
+                        }
+                        stamps[i] = s;
+                        double ddx = entries[i].x - x, ddy = entries[i].y - y;
+                        double d2 = ddx * ddx + ddy * ddy;
+                        if (int32_t(best.size()) < k) {
+                            best.push({d2, i});
+                        } else if (d2 < best.top().first) {
+                            best.pop();
+                            best.push({d2, i});
+                        }
+                    }
+                }
+                if (ring == 0) {
+                    break;
+                }
+            }
+        }
+        // everything not seen yet lies outside the rings visited so far
+        double bound = std::numeric_limits<double>::infinity();
+        if (cx - ring > 0) {
+            bound = std::min(bound, double(x - origin - (cx - ring) * cell_size));
+        }
+        if (cx + ring < cols - 1) {
+            bound = std::min(bound, double(origin + (cx + ring + 1) * cell_size - x));
+        }
+        if (cy - ring > 0) {
+            bound = std::min(bound, double(y - origin - (cy - ring) * cell_size));
+        }
+        if (cy + ring < rows - 1) {
+            bound = std::min(bound, double(origin + (cy + ring + 1) * cell_size - y));
+        }
+        if (bound == std::numeric_limits<double>::infinity()) {
+            break;
+        }
+        bound = std::max(bound, 0.);
+        if (int32_t(best.size()) == k && best.top().first <= bound * bound) {
+            break;
+        }
+    }
+    out.resize(best.size());
+    for (int i = out.size() - 1; i >= 0; --i) {
+        out[i] = entries[best.top().second].id;
+        best.pop();
+    }
+}
+
+
+void SpatialGrid::within_radius(int32_t x, int32_t y, double radius, std::vector<int32_t> &out) const {
+    out.clear();
+    if (!built) {
+        return;
+    }
+    uint32_t s = next_stamp();
+    int32_t ir = std::ceil(radius);
+    double r2 = radius * radius;
+    for (int32_t r = row_of(y - ir); r <= row_of(y + ir); ++r) {
+        for (int32_t c = col_of(x - ir); c <= col_of(x + ir); ++c) {
+            int32_t cell = r * cols + c;
+            for (int32_t it = cell_start[cell]; it < cell_start[cell + 1]; ++it) {
+                int32_t i = cell_items[it];
+                if (stamps[i] != s) {
+                    stamps[i] = s;
+                    if (entries[i].box.dist2(x, y) <= r2) {
+                        out.push_back(entries[i].id);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void SpatialGrid::within_box(const AABB &box, std::vector<int32_t> &out) const {
+    out.clear();
+    if (!built) {
+        return;
+    }
+    uint32_t s = next_stamp();
+    for (int32_t r = row_of(box.y0); r <= row_of(box.y1 - 1); ++r) {
+        for (int32_t c = col_of(box.x0); c <= col_of(box.x1 - 1); ++c) {
+            int32_t cell = r * cols + c;
+            for (int32_t it = cell_start[cell]; it < cell_start[cell + 1]; ++it) {
+                int32_t i = cell_items[it];
+                if (stamps[i] != s) {
+                    stamps[i] = s;
+                    tests++;
+                    if (entries[i].box.overlaps(box)) {
+                        out.push_back(entries[i].id);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+int32_t SpatialGrid::raycast(double x, double y, double dx, double dy, double max_dist) const {
+    double len = std::sqrt(dx * dx + dy * dy);
+    if (!built || len == 0) {
+        return -1;
+    }
+    dx /= len, dy /= len;
+    double t, tend;
+    if (!slab(origin, origin, origin + cols * cell_size, origin + rows * cell_size, x, y, dx, dy, t, tend)) {
+        return -1;
+    }
+    tend = std::min(tend, max_dist);
+    uint32_t s = next_stamp();
+    int32_t c = col_of(x + dx * t), r = row_of(y + dy * t);
+    int32_t stepc = dx > 0 ? 1 : -1, stepr = dy > 0 ? 1 : -1;
+    double inf = std::numeric_limits<double>::infinity();
+    double tdeltac = dx != 0 ? cell_size / std::abs(dx) : inf;
+    double tdeltar = dy != 0 ? cell_size / std::abs(dy) : inf;
+    double tmaxc = dx != 0 ? (origin + (c + (dx > 0)) * cell_size - x) / dx : inf;
+    double tmaxr = dy != 0 ? (origin + (r + (dy > 0)) * cell_size - y) / dy : inf;
+    double best_t = inf;
+    int32_t best = -1;
+    while (t <= tend && t <= best_t) {
+        int32_t cell = r * cols + c;
+        for (int32_t it = cell_start[cell]; it < cell_start[cell + 1]; ++it) {
+            int32_t i = cell_items[it];
+            if (stamps[i] == s) {
+                continue;
+            }
+            stamps[i] = s;
+            double thit;
+            if (entries[i].box.ray_hit(x, y, dx, dy, thit) && thit <= max_dist && thit < best_t) {
+                best_t = thit;
+                best = entries[i].id;
+            }
+        }
+        if (tmaxc < tmaxr) {
+            t = tmaxc;
+            tmaxc += tdeltac;
+            c += stepc;
+        } else {
+            t = tmaxr;
+            tmaxr += tdeltar;
+            r += stepr;
+        }
+        if (c < 0 || c >= cols || r < 0 || r >= rows) {
+            break;
+        }
+    }
+    return best;
+}
+
+
+// how many entries an entry shares its cells with on average, itself included
+double SpatialGrid::crowding() const {
+    if (!built || cell_items.empty()) {
+        return 0;
+    }
+    int64_t sum = 0;
+    for (int32_t cell = 0; cell < cols * rows; ++cell) {
+        int64_t n = cell_start[cell + 1] - cell_start[cell];
+        sum += n * n;
+    }
+    return double(sum) / cell_items.size();
+}
+
+
+// QuadTree
+void QuadTree::clear() {
+    items.clear();
+    nodes.clear();
+}
+
+
+void QuadTree::insert(int32_t id, int32_t x, int32_t y, int32_t w2, int32_t h2) {
+    items.push_back({id, x, y, AABB::centered(x, y, w2, h2)});
+}
+
+
+void QuadTree::build() {
+    nodes.clear();
+    nodes.push_back(Node());
+    nodes[0].end = items.size();
+    split(0, 0);
+}
+
+
+void QuadTree::split(int32_t node, int32_t depth) {
+    int32_t begin = nodes[node].begin, end = nodes[node].end;
+    AABB bounds(INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN);
+    AABB centers = bounds;
+    for (int32_t i = begin; i < end; ++i) {
+        const Item &it = items[i];
+        bounds = AABB(std::min(bounds.x0, it.box.x0), std::min(bounds.y0, it.box.y0), std::max(bounds.x1, it.box.x1), std::max(bounds.y1, it.box.y1));
+        centers = AABB(std::min(centers.x0, it.x), std::min(centers.y0, it.y), std::max(centers.x1, it.x), std::max(centers.y1, it.y));
+    }
+    nodes[node].bounds = bounds;
+    // stacked entities can not be separated by splitting any further
+    if (end - begin <= leaf_size || depth == max_depth || (centers.x0 == centers.x1 && centers.y0 == centers.y1)) {
+        return;
+    }
+    int32_t mx = centers.x0 + (centers.x1 - centers.x0) / 2, my = centers.y0 + (centers.y1 - centers.y0) / 2;
+    auto it_begin = items.begin() + begin, it_end = items.begin() + end;
+    auto ymid = std::partition(it_begin, it_end, [my](const Item &it) {return it.y <= my;});
+    auto xmid_top = std::partition(it_begin, ymid, [mx](const Item &it) {return it.x <= mx;});
+    auto xmid_bottom = std::partition(ymid, it_end, [mx](const Item &it) {return it.x <= mx;});
+    int32_t cuts[5] = {begin, int32_t(xmid_top - items.begin()), int32_t(ymid - items.begin()), int32_t(xmid_bottom - items.begin()), end};
+    int32_t first = nodes.size();
+    nodes[node].first_child = first;
+    for (int c = 0; c < 4; ++c) {
+        Node child;
+        child.begin = cuts[c];
+        child.end = cuts[c + 1];
+        nodes.push_back(child);
+    }
+    for (int c = 0; c < 4; ++c) {
+        if (nodes[first + c].begin != nodes[first + c].end) {
+            split(first + c, depth + 1);
+        } else {
+            nodes[first + c].bounds = AABB(INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN);
+        }
+    }
+}
+
+
+void QuadTree::within_box(const AABB &box, std::vector<int32_t> &out) const {
+    out.clear();
+    if (nodes.empty()) {
+        return;
+    }
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const Node &n = nodes[stack.back()];
+        stack.pop_back();
+        tests++;
+        if (!n.bounds.overlaps(box)) {
+            continue;
+        }
+        if (n.first_child != -1) {
+            for (int c = 0; c < 4; ++c) {
+                if (nodes[n.first_child + c].begin != nodes[n.first_child + c].end) {
+                    stack.push_back(n.first_child + c);
+                }
+            }
+            continue;
+        }
+        for (int32_t i = n.begin; i < n.end; ++i) {
+            tests++;
+            if (items[i].box.overlaps(box)) {
+                out.push_back(items[i].id);
+            }
+        }
+    }
+}
+
+
+// SweepAndPrune
+void SweepAndPrune::clear() {
+    ids.clear();
+    categories.clear();
+    masks.clear();
+    boxes.clear();
+}
+
+
+void SweepAndPrune::insert(int32_t id, uint8_t category, uint8_t mask, int32_t x, int32_t y, int32_t w2, int32_t h2) {
+    ids.push_back(id);
+    categories.push_back(category);
+    masks.push_back(mask);
+    boxes.push_back(AABB::centered(x, y, w2, h2));
+}
+
+
+// LSD radix sort of the left edges, one byte per pass. Every thread histograms and then
+// scatters its own slice, slices are laid out in order so the sort stays stable.
+void SweepAndPrune::radix_sort(ThreadPool &pool) {
+    int32_t n = boxes.size();
+    keys.resize(n);
+    keys_tmp.resize(n);
+    order.resize(n);
+    order_tmp.resize(n);
+    uint32_t all_or = 0, all_and = ~0u;
+    for (int32_t i = 0; i < n; ++i) {
+        keys[i] = uint32_t(boxes[i].x0) ^ 0x80000000u;
+        order[i] = i;
+        all_or |= keys[i];
+        all_and &= keys[i];
+    }
+    const int32_t min_chunk = 4096;
+    int32_t nchunks = std::max(std::min(pool.size(), (n + min_chunk - 1) / min_chunk), 1);
+    int32_t chunk = (n + nchunks - 1) / nchunks;
+    histograms.resize(nchunks * 256);
+    for (int shift = 0; shift < 32; shift += 8) {
+        // bytes every key agrees on do not change the order
+        if ((((all_or ^ all_and) >> shift) & 0xff) == 0) {
+            continue;
+        }
+        std::fill(histograms.begin(), histograms.end(), 0);
+        pool.run(nchunks, [&](int32_t c) {
+            uint32_t *hist = &histograms[c * 256];
+            for (int32_t i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i) {
+                hist[(keys[i] >> shift) & 0xff]++;
+            }
+        });
+        uint32_t sum = 0;
+        for (int32_t digit = 0; digit < 256; ++digit) {
+            for (int32_t c = 0; c < nchunks; ++c) {
+                uint32_t cnt = histograms[c * 256 + digit];
+                histograms[c * 256 + digit] = sum;
+                sum += cnt;
+            }
+        }
+        pool.run(nchunks, [&](int32_t c) {
+            uint32_t *offset = &histograms[c * 256];
+            for (int32_t i = c * chunk; i < std::min(n, (c + 1) * chunk); ++i) {
+                uint32_t dst = offset[(keys[i] >> shift) & 0xff]++;
+                keys_tmp[dst] = keys[i];
+                order_tmp[dst] = order[i];
+            }
+        });
+        keys.swap(keys_tmp);
+        order.swap(order_tmp);
+    }
+}
+
+
+void SweepAndPrune::gather(int32_t begin, int32_t end) {
+    for (int32_t p = begin; p < end; ++p) {
+        int32_t i = order[p];
+        sx0[p] = boxes[i].x0;
+        sx1[p] = boxes[i].x1;
+        sy0[p] = boxes[i].y0;
+        sy1[p] = boxes[i].y1;
+        sid[p] = ids[i];
+        scat[p] = categories[i];
+        smask[p] = masks[i];
+    }
+}
+
+
+void SweepAndPrune::sweep(int32_t begin, int32_t end, std::vector<std::pair<int32_t, int32_t>> &out) const {
+    int32_t n = sx0.size();
+    for (int32_t p = begin; p < end; ++p) {
+        int32_t x1 = sx1[p], y0 = sy0[p], y1 = sy1[p];
+        uint8_t cat = scat[p], mask = smask[p];
+        for (int32_t q = p + 1; q < n && sx0[q] < x1; ++q) {
+            if (((mask & scat[q]) || (smask[q] & cat)) && y0 < sy1[q] && sy0[q] < y1) {
+                if (cat <= scat[q]) {
+                    out.push_back({sid[p], sid[q]});
+                } else {
+                    out.push_back({sid[q], sid[p]});
+                }
+            }
+        }
+    }
+}
+
+
+void SweepAndPrune::find_pairs(std::vector<std::pair<int32_t, int32_t>> &out, ThreadPool &pool) {
+    out.clear();
+    radix_sort(pool);
+    int32_t n = order.size();
+    for (std::vector<int32_t> *v: {&sx0, &sx1, &sy0, &sy1, &sid}) {
+        v->resize(n);
+    }
+    scat.resize(n);
+    smask.resize(n);
+    const int32_t min_chunk = 1024;
+    // more chunks than threads keeps the load even when one end of the screen is crowded
+    int32_t nchunks = std::max(std::min(pool.size() * 4, (n + min_chunk - 1) / min_chunk), 1);
+    int32_t chunk = (n + nchunks - 1) / nchunks;
+    if (int32_t(chunk_pairs.size()) < nchunks) {
+        chunk_pairs.resize(nchunks);
+    }
+    pool.run(nchunks, [&](int32_t c) {
+        gather(c * chunk, std::min(n, (c + 1) * chunk));
+    });
+    pool.run(nchunks, [&](int32_t c) {
+        chunk_pairs[c].clear();
+        sweep(c * chunk, std::min(n, (c + 1) * chunk), chunk_pairs[c]);
+    });
+    for (int32_t c = 0; c < nchunks; ++c) {
+        out.insert(out.end(), chunk_pairs[c].begin(), chunk_pairs[c].end());
+    }
+}
+
+
+void SweepAndPrune::find_pairs_serial(std::vector<std::pair<int32_t, int32_t>> &out) {
+    out.clear();
+    int32_t n = boxes.size();
+    order.resize(n);
+    for (int32_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int32_t a, int32_t b) {return boxes[a].x0 < boxes[b].x0;});
+    for (std::vector<int32_t> *v: {&sx0, &sx1, &sy0, &sy1, &sid}) {
+        v->resize(n);
+    }
+    scat.resize(n);
+    smask.resize(n);
+    gather(0, n);
+    sweep(0, n, out);
+}
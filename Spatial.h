@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+class ThreadPool;
+
+
+struct AABB {
+    int32_t x0 = 0, y0 = 0;
+    int32_t x1 = 0, y1 = 0;
+
+    AABB(){}
+    AABB(int32_t x0, int32_t y0, int32_t x1, int32_t y1): x0(x0), y0(y0), x1(x1), y1(y1) {}
+    static AABB centered(int32_t x, int32_t y, int32_t w2, int32_t h2) {return AABB(x - w2, y - h2, x + w2, y + h2);}
+    bool overlaps(const AABB &o) const {return x0 < o.x1 && o.x0 < x1 && y0 < o.y1 && o.y0 < y1;}
+    double dist2(double x, double y) const;
+    bool ray_hit(double x, double y, double dx, double dy, double &t) const;
+};
+
+
+// Uniform grid over the screen. Entities are inserted into every cell their box covers,
+// queries return the ids the entities were inserted with.
+class SpatialGrid {
+    struct Entry {
+        int32_t id;
+        int32_t x, y;
+        AABB box;
+    };
+
+    int32_t cell_size, origin, cols, rows;
+    std::vector<Entry> entries;
+    std::vector<int32_t> cell_start;
+    std::vector<int32_t> cell_items;
+    std::vector<int32_t> cell_fill;
+    mutable std::vector<uint32_t> stamps;
+    mutable uint32_t stamp = 0;
+    mutable int64_t tests = 0;
+    bool built = false;
+
+    int32_t col_of(int32_t x) const;
+    int32_t row_of(int32_t y) const;
+    uint32_t next_stamp() const;
+    public:
+    SpatialGrid(int32_t cell_size = 64);
+
+    void clear();
+    void insert(int32_t id, int32_t x, int32_t y, int32_t w2, int32_t h2);
+    void build();
+    int32_t size() const {return entries.size();}
+
+    void nearest(int32_t x, int32_t y, int32_t k, std::vector<int32_t> &out) const;
+    void within_radius(int32_t x, int32_t y, double radius, std::vector<int32_t> &out) const;
+    void within_box(const AABB &box, std::vector<int32_t> &out) const;
+    int32_t raycast(double x, double y, double dx, double dy, double max_dist) const;
+    double crowding() const;
+    int64_t pair_tests() const {return tests;}
+};
+
+
+// Quadtree rebuilt from scratch every frame. Nodes split on the centers of their items
+// until they are small enough, and every node keeps the bounds fitted to the boxes below it,
+// so a dense cluster costs a single node test for a query that passes next to it.
+class QuadTree {
+    struct Item {
+        int32_t id;
+        int32_t x, y;
+        AABB box;
+    };
+    struct Node {
+        AABB bounds;
+        int32_t first_child = -1;
+        int32_t begin = 0, end = 0;
+    };
+
+    std::vector<Item> items;
+    std::vector<Node> nodes;
+    int32_t leaf_size, max_depth;
+    mutable std::vector<int32_t> stack;
+    mutable int64_t tests = 0;
+
+    void split(int32_t node, int32_t depth);
+    public:
+    QuadTree(int32_t leaf_size = 8, int32_t max_depth = 16): leaf_size(leaf_size), max_depth(max_depth) {}
+
+    void clear();
+    void insert(int32_t id, int32_t x, int32_t y, int32_t w2, int32_t h2);
+    void build();
+    int32_t size() const {return items.size();}
+    int32_t node_count() const {return nodes.size();}
+
+    void within_box(const AABB &box, std::vector<int32_t> &out) const;
+    int64_t pair_tests() const {return tests;}
+};
+
+
+// Sort and sweep along x for very large entity counts. Boxes are sorted by their left edge
+// with a parallel radix sort and the sweep is split between the pool threads, the pairs come
+// out in the same order as from the serial reference. Two boxes pair up when the mask of one
+// has the category bit of the other, the id of the lower category comes first in the pair.
+class SweepAndPrune {
+    std::vector<int32_t> ids;
+    std::vector<uint8_t> categories, masks;
+    std::vector<AABB> boxes;
+    std::vector<uint32_t> keys, keys_tmp;
+    std::vector<int32_t> order, order_tmp;
+    std::vector<std::vector<std::pair<int32_t, int32_t>>> chunk_pairs;
+    std::vector<uint32_t> histograms;
+    // boxes copied out in sweep order so the inner loop walks memory linearly
+    std::vector<int32_t> sx0, sx1, sy0, sy1, sid;
+    std::vector<uint8_t> scat, smask;
+
+    void radix_sort(ThreadPool &pool);
+    void gather(int32_t begin, int32_t end);
+    void sweep(int32_t begin, int32_t end, std::vector<std::pair<int32_t, int32_t>> &out) const;
+    public:
+    void clear();
+    void insert(int32_t id, uint8_t category, uint8_t mask, int32_t x, int32_t y, int32_t w2, int32_t h2);
+    int32_t size() const {return ids.size();}
+
+    void find_pairs(std::vector<std::pair<int32_t, int32_t>> &out, ThreadPool &pool);
+    void find_pairs_serial(std::vector<std::pair<int32_t, int32_t>> &out);
+};
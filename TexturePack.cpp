@@ -0,0 +1,167 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "TexturePack.h"
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+Pixel* decode_image(const char *path, int &width, int &height, int &channels) {
+    Pixel *pixels = (Pixel*)stbi_load(path, &width, &height, &channels, sizeof(Pixel));
+    if (pixels == nullptr) {
+        width = height = channels = 0;
+        return nullptr;
+    }
+    for (int i = 0; i < width * height; ++i) {
+        pixels[i] = pixels[i].swap_colors();
+        pixels[i].set_black(0xff);
+    }
+    return pixels;
+}
+
+
+void free_image(Pixel *pixels) {
+    stbi_image_free(pixels);
+}
+
+
+bool trim_image(const Pixel *pixels, int width, int height, std::vector<Pixel> &out, int &new_width, int &new_height) {
+    int imin = height, imax = 0, jmin = width, jmax = 0;
+    for (int i = 0; i < height; ++i) {
+        for (int j = 0; j < width; ++j) {
+            if (pixels[i * width + j].is_color()) {
+                imax = i + 1;
+                if (imin > i) {
+                    imin = i;
+                }
+                if (jmax < j) {
+                    jmax = j + 1;
+                }
+                if (jmin > j) {
+                    jmin = j;
+                }
+            }
+        }
+    }
+    if (jmax - jmin <= 0 || imax - imin <= 0) {
+        return false;
+    }
+    new_height = imax - imin + 2, new_width = jmax - jmin + 2;
+    out.assign(new_height * new_width, Pixel());
+    for (int i = 0; i < height; ++i) {
+        int ioff = i - imin;
+        for (int j = 0; j < width; ++j) {
+            if (pixels[i * width + j].is_color()) {
+                out[ioff * new_width + j - jmin] = pixels[i * width + j];
+            }
+        }
+    }
+    return true;
+}
+
+
+static uint64_t align_up(uint64_t n) {
+    return (n + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+}
+
+
+bool write_pack(const char *path, const std::vector<BakedTexture> &textures, std::ostream &err) {
+    PackHeader header;
+    header.count = textures.size();
+    std::vector<PackEntry> entries(textures.size());
+    uint64_t offset = align_up(sizeof(PackHeader) + entries.size() * sizeof(PackEntry));
+    for (size_t k = 0; k < textures.size(); ++k) {
+        const BakedTexture &t = textures[k];
+        if (t.path.size() >= PACK_PATH_LEN) {
+            err << "path too long for a pack: " << t.path << std::endl;
+            return false;
+        }
+        PackEntry &e = entries[k];
+        memset(&e, 0, sizeof(e));
+        strcpy(e.path, t.path.c_str());
+        e.width = t.width, e.height = t.height, e.channels = t.channels;
+        e.tight = t.tight;
+        e.offset = offset;
+        offset = align_up(offset + t.pixels.size() * sizeof(Pixel));
+    }
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        err << "cannot write " << path << std::endl;
+        return false;
+    }
+    const char zeros[PACK_ALIGN] = {};
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)entries.data(), entries.size() * sizeof(PackEntry));
+    for (size_t k = 0; k < textures.size(); ++k) {
+        out.write(zeros, entries[k].offset - uint64_t(out.tellp()));
+        out.write((const char*)textures[k].pixels.data(), textures[k].pixels.size() * sizeof(Pixel));
+    }
+    out.write(zeros, offset - uint64_t(out.tellp()));
+    if (!out) {
+        err << "cannot write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+// a pack that does not add up is left closed so the game falls back to the PNGs
+bool TexturePack::open(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= off_t(sizeof(PackHeader))) {
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const uint8_t *bytes = (const uint8_t*)map;
+    size_t size = st.st_size;
+    const PackHeader &header = *(const PackHeader*)bytes;
+    bool valid = header.magic == PACK_MAGIC && header.version == PACK_VERSION
+              && sizeof(PackHeader) + uint64_t(header.count) * sizeof(PackEntry) <= size;
+    const PackEntry *list = (const PackEntry*)(bytes + sizeof(PackHeader));
+    for (uint32_t k = 0; valid && k < header.count; ++k) {
+        const PackEntry &e = list[k];
+        uint64_t bytes_of = uint64_t(e.width) * e.height * sizeof(Pixel);
+        valid = memchr(e.path, 0, PACK_PATH_LEN) != nullptr && e.width > 0 && e.height > 0
+             && e.offset % PACK_ALIGN == 0 && e.offset <= size && bytes_of <= size - e.offset;
+    }
+    if (!valid) {
+        munmap(map, size);
+        return false;
+    }
+    base = bytes, length = size;
+    entries = list, count = header.count;
+    return true;
+}
+
+
+const PackEntry* TexturePack::find(const char *path, bool tight) const {
+    for (uint32_t k = 0; k < count; ++k) {
+        if (entries[k].tight == tight && strcmp(entries[k].path, path) == 0) {
+            return &entries[k];
+        }
+    }
+    return nullptr;
+}
+
+
+const TexturePack& texture_pack() {
+    static TexturePack *pack = [] {
+        TexturePack *p = new TexturePack;
+        const char *path = getenv("GW_PACK");
+        p->open(path != nullptr ? path : TEXTURE_PACK);
+        return p;
+    }();
+    return *pack;
+}
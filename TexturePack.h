@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Pixel.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#define PACK_MAGIC 0x4b434150
+#define PACK_VERSION 1
+#define PACK_ALIGN 64
+#define PACK_PATH_LEN 64
+#define TEXTURE_PACK "textures.pack"
+
+
+// A texture pack is a PackHeader, count PackEntry records and then the pixels of every entry,
+// each starting on a PACK_ALIGN boundary, rows top to bottom, ready to draw as they are.
+struct PackHeader {
+    uint32_t magic = PACK_MAGIC;
+    uint32_t version = PACK_VERSION;
+    uint32_t count = 0;
+    uint32_t reserved = 0;
+};
+
+
+struct PackEntry {
+    char path[PACK_PATH_LEN];
+    int32_t width, height, channels;
+    uint32_t tight;
+    uint64_t offset;
+};
+
+
+// A texture as the bake tool writes it into a pack.
+struct BakedTexture {
+    std::string path;
+    bool tight = false;
+    int width = 0, height = 0, channels = 0;
+    std::vector<Pixel> pixels;
+};
+
+
+// A pack mapped read only for the whole run. Pixels handed out point into the mapping.
+class TexturePack {
+    const uint8_t *base = nullptr;
+    size_t length = 0;
+    const PackEntry *entries = nullptr;
+    uint32_t count = 0;
+    public:
+    bool open(const char *path);
+    bool is_open() const {return base != nullptr;}
+    uint32_t size() const {return count;}
+    const PackEntry* find(const char *path, bool tight) const;
+    const Pixel* pixels(const PackEntry &e) const {return (const Pixel*)(base + e.offset);}
+};
+
+
+// The pack of the game, GW_PACK or TEXTURE_PACK. Without one it stays closed and the
+// textures are decoded from their PNGs.
+const TexturePack& texture_pack();
+
+// Decodes a PNG into the pixels the game draws: colors in Pixel order, black transparent and
+// every other color opaque. The result is freed with free_image().
+Pixel* decode_image(const char *path, int &width, int &height, int &channels);
+void free_image(Pixel *pixels);
+
+// Cuts an image down to its colored part plus two spare rows and columns at the bottom right,
+// false when nothing in it is colored.
+bool trim_image(const Pixel *pixels, int width, int height, std::vector<Pixel> &out, int &new_width, int &new_height);
+
+bool write_pack(const char *path, const std::vector<BakedTexture> &textures, std::ostream &err);
@@ -0,0 +1,52 @@
+#include "TimerWheel.h"
+
+
+TimerWheel::TimerWheel(uint64_t start): current(start) {
+    for (int32_t level = 0; level < WHEEL_LEVELS; ++level) {
+        for (int32_t s = 0; s < WHEEL_SLOTS; ++s) {
+            heads[level][s] = -1;
+        }
+    }
+}
+
+
+// due steps past the top ring wrap around in it and are put back there every time they cascade
+void TimerWheel::link(int32_t e) {
+    uint64_t due = entries[e].due;
+    int32_t level = 0;
+    while (level < WHEEL_LEVELS - 1 && (due >> ((level + 1) * WHEEL_BITS)) != (current >> ((level + 1) * WHEEL_BITS))) {
+        ++level;
+    }
+    int32_t &head = heads[level][(due >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1)];
+    entries[e].next = head;
+    head = e;
+}
+
+
+void TimerWheel::cascade(int32_t level) {
+    int32_t &head = heads[level][(current >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1)];
+    int32_t e = head;
+    head = -1;
+    while (e != -1) {
+        int32_t next = entries[e].next;
+        link(e);
+        e = next;
+    }
+}
+
+
+// delay and period in steps, a period of 0 fires once
+void TimerWheel::schedule(uint32_t delay, uint32_t period, const TimerEvent &event) {
+    int32_t e = free_head;
+    if (e == -1) {
+        e = entries.size();
+        entries.emplace_back();
+    } else {
+        free_head = entries[e].next;
+    }
+    entries[e].due = current + (delay > 0 ? delay : 1);
+    entries[e].period = period;
+    entries[e].event = event;
+    link(e);
+    ++count;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "SlotMap.h"
+
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+
+struct TimerEvent {
+    uint32_t kind = 0;
+    Handle target;
+};
+
+
+// Timers counted in simulation steps, kept in WHEEL_LEVELS rings of WHEEL_SLOTS lists. A timer
+// sits in the lowest ring whose digit of the due step is the first to differ from the current
+// step and moves down a ring when the current step reaches that digit, so a step only touches
+// the timers that expire in it and the ones cascading down. Timers are entries of one array
+// chained through next, scheduling and firing do not allocate once the array has grown.
+class TimerWheel {
+    struct Entry {
+        uint64_t due;
+        uint32_t period;
+        TimerEvent event;
+        int32_t next;
+    };
+
+    std::vector<Entry> entries;
+    int32_t free_head = -1;
+    int32_t heads[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t current;
+    int32_t count = 0;
+
+    void link(int32_t e);
+    void cascade(int32_t level);
+    public:
+    explicit TimerWheel(uint64_t start = 0);
+
+    void schedule(uint32_t delay, uint32_t period, const TimerEvent &event);
+    int32_t size() const {return count;}
+
+    // Runs every step up to and including to. fn(const TimerEvent&) is called for each timer
+    // that expires, a periodic timer is scheduled again unless fn returns false.
+    template <class F>
+    void advance(uint64_t to, F fn) {
+        while (current < to) {
+            ++current;
+            for (int32_t level = WHEEL_LEVELS - 1; level > 0; --level) {
+                if ((current & ((uint64_t(1) << (level * WHEEL_BITS)) - 1)) == 0) {
+                    cascade(level);
+                }
+            }
+            int32_t e = heads[0][current & (WHEEL_SLOTS - 1)];
+            heads[0][current & (WHEEL_SLOTS - 1)] = -1;
+            while (e != -1) {
+                int32_t next = entries[e].next;
+                TimerEvent event = entries[e].event;
+                if (fn(event) && entries[e].period > 0) {
+                    entries[e].due += entries[e].period;
+                    link(e);
+                } else {
+                    entries[e].next = free_head;
+                    free_head = e;
+                    --count;
+                }
+                e = next;
+            }
+        }
+    }
+};
@@ -0,0 +1,53 @@
+#include "Waves.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+
+
+static bool parse_formation(const std::string &name, int32_t &formation) {
+    const char *names[] = {"edges", "ring", "line", "cluster"};
+    for (int32_t f = 0; f < 4; ++f) {
+        if (name == names[f]) {
+            formation = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool load_wave_table(const char *path, WaveTable &table, std::ostream &err) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    for (int32_t number = 1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first)) {
+            continue;
+        }
+        if (first == "repeat") {
+            double seconds;
+            if (fields >> seconds >> table.level_step && seconds > 0) {
+                table.repeat_ms = int64_t(seconds * 1000);
+                continue;
+            }
+        } else {
+            Wave w;
+            std::string formation;
+            std::istringstream at(first);
+            double seconds;
+            if (at >> seconds && fields >> w.chasers >> w.bouncers >> w.shooters >> formation >> w.spread >> w.level
+                    && parse_formation(formation, w.formation) && seconds >= 0) {
+                w.at_ms = int64_t(seconds * 1000);
+                table.waves.push_back(w);
+                continue;
+            }
+        }
+        err << path << ":" << number << ": bad wave line" << std::endl;
+    }
+    return true;
+}
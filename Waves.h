@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+
+enum Formation {
+    EDGES_FORMATION,
+    RING_FORMATION,
+    LINE_FORMATION,
+    CLUSTER_FORMATION
+};
+
+
+// One line of a wave table: at the given second that many mobs of each type come in together,
+// placed by the formation. level stands in for the difficulty multiplier of the spawner for the
+// mobs of the wave and grows by level_step every time the table repeats.
+struct Wave {
+    int64_t at_ms = 0;
+    int32_t chasers = 0, bouncers = 0, shooters = 0;
+    int32_t formation = EDGES_FORMATION;
+    double spread = 0;
+    double level = 0;
+};
+
+
+struct WaveTable {
+    std::vector<Wave> waves;
+    int64_t repeat_ms = 0;
+    double level_step = 0;
+};
+
+
+// Where mob k of the n of a wave comes in. anchor is drawn once per wave and picks the side
+// of a line or cluster and turns a ring.
+struct Placement {
+    int32_t formation = EDGES_FORMATION;
+    int32_t k = 0, n = 1;
+    double spread = 0;
+    double anchor = 0;
+};
+
+
+// Reads a wave table, one wave per line:
+//     <second> <chasers> <bouncers> <shooters> <edges|ring|line|cluster> <spread> <level>
+// plus an optional "repeat <seconds> <level step>" line that plays the table again every that
+// many seconds. '#' starts a comment. Lines that do not parse are reported to err and skipped,
+// false if the file cannot be read.
+bool load_wave_table(const char *path, WaveTable &table, std::ostream &err);
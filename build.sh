@@ -3,5 +3,7 @@ rm -f cmake_install.cmake
 rm -f CMakeCache.txt
 rm -f Makefile
 rm -f game
+rm -f bake_textures
+rm -f textures.pack
 cmake CMakeLists.txt
 make
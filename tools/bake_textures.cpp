@@ -0,0 +1,58 @@
+#include "../TexturePack.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+
+// Bakes every PNG of a directory into the texture pack the game maps at startup in place of
+// decoding them. Each image goes in as decoded and once more trimmed the way
+// Texture::tighten_image trims it, the two ways the game asks for a texture. After set_black
+// every pixel is either black and transparent or fully opaque, so the colors are already
+// premultiplied and go in as they are.
+//
+// usage: bake_textures [directory [pack]], textures and textures.pack by default
+int main(int argc, char **argv) {
+    std::string dir = argc > 1 ? argv[1] : "textures";
+    const char *pack = argc > 2 ? argv[2] : TEXTURE_PACK;
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        std::cerr << "cannot open " << dir << std::endl;
+        return 1;
+    }
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+
+    std::vector<BakedTexture> textures;
+    size_t bytes = 0;
+    for (const std::string &name: names) {
+        BakedTexture plain;
+        plain.path = dir + "/" + name;
+        Pixel *pixels = decode_image(plain.path.c_str(), plain.width, plain.height, plain.channels);
+        if (pixels == nullptr) {
+            std::cerr << "cannot decode " << plain.path << std::endl;
+            return 1;
+        }
+        plain.pixels.assign(pixels, pixels + plain.width * plain.height);
+        free_image(pixels);
+        BakedTexture tight = plain;
+        tight.tight = true;
+        trim_image(plain.pixels.data(), plain.width, plain.height, tight.pixels, tight.width, tight.height);
+        bytes += (plain.pixels.size() + tight.pixels.size()) * sizeof(Pixel);
+        textures.push_back(std::move(plain));
+        textures.push_back(std::move(tight));
+    }
+    if (!write_pack(pack, textures, std::cerr)) {
+        return 1;
+    }
+    std::cout << pack << ": " << names.size() << " images, " << textures.size() << " textures, " << bytes / 1024 << " KiB of pixels" << std::endl;
+    return 0;
+}